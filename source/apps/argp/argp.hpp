@@ -149,6 +149,12 @@ struct params_t : public argparse::Args
 
     int &topmatches                      = kwarg("top,topmatches", "number of top PSMs to print in the output (inactive option)").set_default(1);
 
+    // two-stage search: top peaks matched in the prefilter
+    int &prefilter                       = kwarg("pf,prefilter", "two-stage search: shortlist candidates with the top N peaks and rescore them with all peaks (0: off). A small N finds fewer candidates, so queries under min_hits PSMs go unreported").set_default(0);
+
+    // two-stage search: shortlist size
+    int &pfkeep                          = kwarg("pfk,prefilter_keep", "two-stage search: candidates per spectrum to rescore with all peaks").set_default(64);
+
     // min PSMs for expect modeling
     int &hits                            = kwarg("hits,min_hits", "minimum candidate PSMs for e-value modeling").set_default(4);
 
@@ -191,6 +197,12 @@ struct params_t : public argparse::Args
     // do not build or use MS/MS cache
     bool &nocache                        = flag("nocache", "do not cache preprocessed MS/MS dataset to .pbin");
 
+    // do not build or use the database index cache
+    bool &nodbcache                      = flag("nodbcache", "do not build or use the database index cache (*.slmidx)");
+
+    // traverse the index chunk-major over groups of queries
+    bool &chunkmajor                     = flag("cm,chunkmajor", "search the index chunk by chunk for groups of queries with close precursor masses");
+
     // use GumbelFit / Survival function modeling instead of TailFit for e_value computation
     bool &gumbelfit                      = flag("e,gfit", "use GumbelFit/Survival instead of TailFit to compute e-values");
 
@@ -227,6 +239,15 @@ void getParams(gParams &params)
     // auto sanitize and set data extension
     params.setindexAndCache(parser.reindex, parser.nocache);
 
+    // database index cache
+    params.nodbcache = parser.nodbcache;
+
+    // index traversal order
+    params.chunkmajor = parser.chunkmajor;
+
+    // match the fragment-ion charges (on by default in MATCH_CHARGE builds)
+    params.matchz = params.matchz || parser.matchcharge;
+
 #if !defined(ARGP_ONLY)
 
     // COMPILER VERSION GCC 9.1.0+ required
@@ -300,6 +321,15 @@ void getParams(gParams &params)
         /* Get the minhits threshold */
         params.min_cpsm = parser.hits;
 
+        // Get the two-stage search parameters
+        params.prefilter = std::max(parser.prefilter, 0);
+        params.pfkeep = std::max(parser.pfkeep, 1);
+
+        if (params.prefilter)
+            std::cerr << "WARNING: The prefilter matches the top " << params.prefilter << " peaks only. "
+                      << "Queries with fewer than " << params.min_cpsm << " candidates (-hits) "
+                      << "are not reported" << std::endl;
+
         // Base Intensity x 1000
         params.base_int = parser.base_int * YAXISMULTIPLIER;
 
@@ -458,6 +488,10 @@ void printParser()
     /* Get the minhits threshold */
     printVar(parser.hits);
 
+    // Get the two-stage search parameters
+    printVar(parser.prefilter);
+    printVar(parser.pfkeep);
+
     // Base Intensity x 1000
     printVar(parser.base_int);
 
@@ -137,6 +137,7 @@ status_t main(int_t argc, char_t* argv[])
     {
         printHeader(HiCOPS, HPC);
         std::cout << std::endl << "Start Time: " << ctime(&start_time) << std::endl;
+        std::cout << "CPU Kernels: " << UTILS_DispatchISA() << std::endl << std::endl;
     }
 
     /* Add all the query files to the vector */
@@ -204,6 +205,30 @@ status_t main(int_t argc, char_t* argv[])
         // set the peptide length in the pepIndex
         slm_index[peplen-minlen].pepIndex.peplen = peplen;
 
+        // memory map the index from the index cache file if it is not stale
+        if (!params.nodbcache)
+        {
+            MARK_START(idx_load);
+
+            status_t loaded = DSLIM_LoadIndexCache((slm_index + peplen - minlen), dbfile);
+
+            MARK_END(idx_load);
+
+            if (loaded == SLM_SUCCESS)
+            {
+                elapsed_seconds = ELAPSED_SECONDS(idx_load);
+
+                if (params.myid == 0)
+                {
+                    std::cout << "Total Index Size      =\t\t" << slm_index[peplen-minlen].totalCount << std::endl << std::endl;
+                    std::cout << "DONE: Index Cache Load:\tstatus: " << loaded << std::endl << std::endl;
+                    PRINT_ELAPSED(elapsed_seconds);
+                }
+
+                continue;
+            }
+        }
+
         MARK_START(lbe_cnt);
 
         // Count the number of ">" entries in FASTA
@@ -297,6 +322,13 @@ status_t main(int_t argc, char_t* argv[])
                 PRINT_ELAPSED(elapsed_seconds);
             }
         }
+
+        /* Save the index to the index cache file for the next runs */
+        if (status == SLM_SUCCESS && !params.nodbcache)
+        {
+            if (DSLIM_WriteIndexCache((slm_index + peplen - minlen), dbfile) != SLM_SUCCESS && params.myid == 0)
+                std::cerr << "WARNING: Unable to write the index cache: " << DSLIM_IndexCachePath(peplen) << std::endl;
+        }
     }
 
     // we don't need the allocated memory anymore
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2019  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include "lwqueue.h"
+
+using namespace std;
+
+/*
+ * The semaphore guarded circular queue that lwqueue
+ * used before the lock-free ring, as the baseline
+ */
+template <class T>
+class semqueue
+{
+private:
+    T     *arr;
+    int_t filled;
+    int_t    cap;
+    int_t   head;
+    int_t   tail;
+    sem_t   lock;
+
+public:
+
+    semqueue(int_t dcap)
+    {
+        cap = dcap;
+        arr = new T[cap];
+        filled = 0;
+        head = 0;
+        tail = -1;
+        sem_init(&lock, 0, 1);
+    }
+
+    ~semqueue()
+    {
+        delete[] arr;
+        sem_destroy(&lock);
+    }
+
+    status_t push(T elmnt)
+    {
+        status_t status = ISFULL;
+
+        sem_wait(&lock);
+
+        if (filled < cap)
+        {
+            tail = (tail + 1) % cap;
+            arr[tail] = elmnt;
+            filled++;
+            status = SLM_SUCCESS;
+        }
+
+        sem_post(&lock);
+
+        return status;
+    }
+
+    status_t pop(T &elmnt)
+    {
+        status_t status = ISEMPTY;
+
+        sem_wait(&lock);
+
+        if (filled > 0)
+        {
+            elmnt = arr[head];
+            head = (head + 1) % cap;
+            filled--;
+            status = SLM_SUCCESS;
+        }
+
+        sem_post(&lock);
+
+        return status;
+    }
+};
+
+/*
+ * FUNCTION: run
+ *
+ * DESCRIPTION: Push and pop nops elements through a queue with
+ *              nprod producer and ncons consumer threads that
+ *              retry while the queue is full or empty
+ *
+ * INPUT:
+ * @q    : The queue
+ * @nprod: Number of producers
+ * @ncons: Number of consumers
+ * @nops : Number of elements
+ *
+ * OUTPUT:
+ * @mops: Million elements per second
+ */
+template <class Q>
+static double_t run(Q &q, int_t nprod, int_t ncons, ull_t nops)
+{
+    std::atomic<ull_t> consumed(0);
+    std::atomic<ull_t> checksum(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> thds;
+
+    for (int_t p = 0; p < nprod; p++)
+    {
+        thds.push_back(std::thread([&, p]()
+        {
+            while (!go);
+
+            for (ull_t i = p; i < nops; i += nprod)
+                while (q.push(i + 1) != SLM_SUCCESS)
+                    std::this_thread::yield();
+        }));
+    }
+
+    for (int_t c = 0; c < ncons; c++)
+    {
+        thds.push_back(std::thread([&]()
+        {
+            ull_t elmnt = 0;
+            ull_t sum = 0;
+
+            while (!go);
+
+            while (consumed.load(std::memory_order_relaxed) < nops)
+            {
+                if (q.pop(elmnt) == SLM_SUCCESS)
+                {
+                    sum += elmnt;
+                    consumed++;
+                }
+                else
+                    std::this_thread::yield();
+            }
+
+            checksum += sum;
+        }));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    go = true;
+
+    for (auto &thd : thds)
+        thd.join();
+
+    std::chrono::duration<double_t> elapsed = std::chrono::steady_clock::now() - start;
+
+    // every element must come out exactly once
+    if (checksum != nops * (nops + 1) / 2)
+    {
+        std::cerr << "ERROR: queue lost or duplicated elements" << std::endl;
+        exit(-1);
+    }
+
+    return nops / elapsed.count() / 1e6;
+}
+
+/*
+ * usage: qbench [max threads per side] [elements] [capacity]
+ */
+status_t main(int_t argc, char_t *argv[])
+{
+    int_t maxthds = (argc > 1) ? atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency() / 2);
+    ull_t nops    = (argc > 2) ? atoll(argv[2]) : 1000000;
+    int_t cap     = (argc > 3) ? atoi(argv[3]) : 20;
+
+    std::cout << "lwqueue throughput (Mops/s), " << nops << " elements, capacity " << cap << std::endl << std::endl;
+    std::cout << std::setw(10) << "prod:cons" << std::setw(14) << "semaphore" << std::setw(14) << "lock-free" << std::endl;
+
+    for (int_t t = 1; t <= maxthds; t *= 2)
+    {
+        semqueue<ull_t> sq(cap);
+        lwqueue<ull_t> lq(cap);
+
+        auto smops = run(sq, t, t, nops);
+        auto lmops = run(lq, t, t, nops);
+
+        std::cout << std::setw(10) << (std::to_string(t) + ":" + std::to_string(t))
+                  << std::setw(14) << std::fixed << std::setprecision(2) << smops
+                  << std::setw(14) << lmops << std::endl;
+    }
+
+    return SLM_SUCCESS;
+}
@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2019  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include "expeRT.h"
+#include "sgsmooth.h"
+
+using namespace std;
+
+gParams params;
+
+/* Reference gradient descent: iterations and learning rate */
+#define GDITERS                  6000
+#define GDRATE                   0.12
+
+/* Significance threshold to compare the e-values at */
+#define ESIGNIF                  0.01
+
+/* A survival histogram as DSLIM_QueryResults models it */
+struct hist_t
+{
+    uint_t cpsms;
+    int_t  maxhypscore;
+    std::vector<double_t> survival;
+};
+
+/*
+ * FUNCTION: gdFit
+ *
+ * DESCRIPTION: The log-Weibull fit that expeRT ran before the
+ *              Levenberg-Marquardt solve: plain gradient descent
+ *              of mu and beta over y[s..e]
+ *
+ * INPUT:
+ * @yy  : The normalized histogram y[s..e]
+ * @s   : First hyperscore bin
+ * @e   : Last hyperscore bin
+ * @mu  : Initial mu
+ * @beta: Fitted beta
+ *
+ * OUTPUT:
+ * @curerr: Squared error of the fit
+ */
+static double_t gdFit(lwvector<double_t> *yy, int_t s, int_t e, double_t &mu, double_t &beta)
+{
+    const double_t cutoff = 1e-3;
+    double_t curerr = INFINITY;
+
+    beta = 4.0;
+
+    darray X1(e - s + 1);
+
+    for (int_t x = s; x <= e; x++)
+        X1[x - s] = x;
+
+    const darray y(yy->data(), yy->Size());
+
+    for (auto i = 0; i < GDITERS; i++)
+    {
+        /* Gumbel distribution response */
+        darray z = (X1 - mu)/beta;
+        darray h_x = (1/beta) * exp(-(z + exp(-z)));
+
+        /* Difference */
+        darray diff = y - h_x;
+
+        /* Current error */
+        curerr = (diff * diff).sum();
+
+        /* Check for break condition */
+        if (curerr < cutoff)
+            break;
+
+        /* Compute the partial derivatives */
+        darray b = -h_x/(beta);
+        darray c = (mu - X1)/beta - (mu-X1)/beta * exp((mu - X1)/beta);
+
+        b = b + b * c;
+
+        auto d = (diff * b).sum();
+
+        darray de = h_x/beta;
+        de = (de - de * exp((mu - X1)/beta));
+
+        auto ee = (diff * de).sum();
+
+        /* Update the mu and beta */
+        mu   += GDRATE * ee;
+        beta += GDRATE * d;
+    }
+
+    return curerr;
+}
+
+/*
+ * FUNCTION: gdModelSurvival
+ *
+ * DESCRIPTION: expeRT::ModelSurvivalFunction with the reference
+ *              gradient descent fit: the same curve region,
+ *              smoothing, normalization and mu estimate
+ *
+ * INPUT:
+ * @h  : The histogram (cpsms >= 1)
+ * @yyt: Scratch vector of expeRT::SIZE
+ *
+ * OUTPUT:
+ * @mu: e-value * 1e6 as stored in Results::mu
+ */
+static int_t gdModelSurvival(const hist_t &h, lwvector<double_t> *yyt)
+{
+    const double_t *yy = h.survival.data();
+    const int_t hyp = h.maxhypscore;
+    const int_t vaa = h.cpsms;
+
+    /* Find the curve region */
+    int_t end1 = hyp - 1;
+    int_t stt1 = 0;
+
+    for (int_t p = hyp - 1; p >= 0; p--)
+        if (yy[p] >= 1.0) { end1 = p; break; }
+
+    for (int_t p = 0; p <= end1; p++)
+        if (yy[p] >= 1.0) { stt1 = p; break; }
+
+    /* To handle special cases */
+    if (stt1 == end1)
+        end1 += 1;
+
+    yyt->Assign((double_t *) yy + stt1, (double_t *) yy + end1 + 1);
+
+    /* Smoothen the curve using Savitzky-Golay filter */
+    int_t svgl = std::min(7, end1 - stt1);
+
+    /* mu estimation markers */
+    auto l = std::max_element(yy + stt1, (yy + end1 + 1)) - (yy + stt1);
+    auto k = l;
+
+    if (svgl % 2 == 0)
+        svgl -= 1;
+
+    if (svgl > 1)
+    {
+        int_t pln = std::min(5, svgl - 1);
+
+        if ((int_t) yyt->Size() >= (svgl-1+2))
+        {
+            lwvector<double_t> yhat(yyt->Size(), 0.0);
+
+            sg_smooth(yyt, &yhat, std::max(1, (svgl-1)/2), pln);
+
+            std::replace_if(yhat.begin(), yhat.end(), isNegative<double_t>, 0);
+
+            yhat.divide((double_t)std::max(std::accumulate(yhat.begin(), yhat.end(), 1), vaa));
+            yyt->divide((double_t)vaa);
+
+            k = std::max_element(yhat.begin(), yhat.end()) - yhat.begin();
+
+            /* Mix yhat (35%) + yyt (65%) */
+            for (auto id = 0; id < (int) yyt->Size(); id++)
+                (*yyt)[id] = yhat[id] * 0.35 + (*yyt)[id] * 0.65;
+        }
+        else
+            yyt->divide((double_t)vaa);
+    }
+    else
+    {
+        const int_t vaa2 = std::max(std::accumulate(yyt->begin(), yyt->end(), 1), vaa);
+        yyt->divide((double_t)vaa2);
+    }
+
+    double_t mu = (stt1 + (k+l)/2.0);
+    double_t beta = 4.0;
+
+    (VOID) gdFit(yyt, stt1, end1, mu, beta);
+
+    /* Modeled response * vaa at hyp */
+    const double_t z = (hyp - mu) / beta;
+
+    return vaa * (1/beta) * exp(-(z + exp(-z))) * 1e6;
+}
+
+/*
+ * FUNCTION: synthesize
+ *
+ * DESCRIPTION: Draw the candidate hyperscores of each query from a
+ *              Gumbel with random location and scale, shaped after the
+ *              histograms of a real search, with the top match set
+ *              apart from the null tail
+ *
+ * INPUT:
+ * @hists : Histograms to fill
+ * @nspecs: Number of queries
+ * @seed  : Random seed
+ *
+ * OUTPUT: none
+ */
+static VOID synthesize(std::vector<hist_t> &hists, ull_t nspecs, ull_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double_t> unif(0.0, 1.0);
+
+    for (ull_t i = 0; i < nspecs; i++)
+    {
+        hist_t h;
+        h.survival.assign(expeRT::SIZE, 0.0);
+
+        const uint_t n = (uint_t) pow(10, 2.5 + 1.1 * unif(rng));
+        const double_t mu = 2 + 5 * unif(rng);
+        const double_t beta = 0.3 + 0.9 * unif(rng);
+        double_t top = 0;
+
+        for (uint_t c = 1; c < n; c++)
+        {
+            double_t x = mu - beta * log(-log(std::max(unif(rng), 1e-300)));
+            x = std::min(std::max(x, 0.1), MAX_HYPERSCORE - 1.0);
+
+            h.survival[(int_t) (x * 10 + 0.5)] += 1;
+            top = std::max(top, x);
+        }
+
+        /* The top match */
+        top = std::min(top + 1 + 59 * unif(rng), MAX_HYPERSCORE - 1.0);
+        h.maxhypscore = (int_t) (top * 10 + 0.5);
+        h.survival[h.maxhypscore] += 1;
+        h.cpsms = n;
+
+        hists.push_back(std::move(h));
+    }
+}
+
+/*
+ * FUNCTION: load
+ *
+ * DESCRIPTION: Read dumped histograms: records of cpsms (uint_t),
+ *              maxhypscore (int_t) and survival (expeRT::SIZE
+ *              double_t) as passed to ModelSurvivalFunction
+ *
+ * INPUT:
+ * @hists: Histograms to fill
+ * @fname: The dump file
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+static status_t load(std::vector<hist_t> &hists, const char_t *fname)
+{
+    FILE *fh = fopen(fname, "rb");
+
+    if (fh == nullptr)
+        return ERR_FILE_NOT_FOUND;
+
+    for (;;)
+    {
+        hist_t h;
+        h.survival.assign(expeRT::SIZE, 0.0);
+
+        if (fread(&h.cpsms, sizeof(uint_t), 1, fh) != 1 ||
+            fread(&h.maxhypscore, sizeof(int_t), 1, fh) != 1 ||
+            fread(h.survival.data(), sizeof(double_t), expeRT::SIZE, fh) != (size_t) expeRT::SIZE)
+            break;
+
+        /* Not modeled without candidates */
+        if (h.cpsms >= 1)
+            hists.push_back(std::move(h));
+    }
+
+    fclose(fh);
+
+    return SLM_SUCCESS;
+}
+
+/*
+ * FUNCTION: model
+ *
+ * DESCRIPTION: Model the e-values of all histograms
+ *
+ * INPUT:
+ * @fit   : Models a histogram into Results::mu
+ * @hists : The histograms
+ * @evals : The e-values
+ *
+ * OUTPUT:
+ * @rate: Spectra modeled per second
+ */
+template <class F>
+static double_t model(F fit, const std::vector<hist_t> &hists, std::vector<double_t> &evals)
+{
+    evals.resize(hists.size());
+
+    auto start = std::chrono::steady_clock::now();
+
+    /* e(x) = n * s(x) = mu * 1e6 as in DSLIM_QueryResults */
+    for (size_t i = 0; i < hists.size(); i++)
+        evals[i] = fit(hists[i]) / 1e6;
+
+    double_t elapsed = std::chrono::duration<double_t>(std::chrono::steady_clock::now() - start).count();
+
+    return hists.size() / elapsed;
+}
+
+/*
+ * usage: wbench [number of synthetic spectra | histogram dump] [seed]
+ */
+status_t main(int_t argc, char_t *argv[])
+{
+    status_t status = SLM_SUCCESS;
+    std::vector<hist_t> hists;
+
+    const char_t *src = (argc > 1) ? argv[1] : "2000";
+    ull_t seed = (argc > 2) ? atoll(argv[2]) : 1;
+
+    if (std::all_of(src, src + strlen(src), ::isdigit))
+        synthesize(hists, atoll(src), seed);
+    else
+        status = load(hists, src);
+
+    if (status != SLM_SUCCESS || hists.empty())
+    {
+        std::cerr << "ERROR: no histograms to model" << std::endl;
+        return ERR_INVLD_PARAM;
+    }
+
+    expeRT lmfit;
+    Results res;
+    std::vector<double_t> survival(expeRT::SIZE);
+    lwvector<double_t> yyt(expeRT::SIZE);
+
+    res.survival = survival.data();
+
+    std::vector<double_t> lm;
+    std::vector<double_t> gd;
+
+    auto lmrate = model([&](const hist_t &h)
+    {
+        /* ModelSurvivalFunction works in place */
+        std::copy(h.survival.begin(), h.survival.end(), survival.begin());
+        res.cpsms = h.cpsms;
+        res.maxhypscore = h.maxhypscore;
+
+        lmfit.ModelSurvivalFunction(&res);
+
+        return res.mu;
+    }, hists, lm);
+
+    auto gdrate = model([&](const hist_t &h) { return gdModelSurvival(h, &yyt); }, hists, gd);
+
+    res.survival = nullptr;
+
+    ull_t same = 0;
+    ull_t agree = 0;
+    double_t maxdiff = 0;
+
+    for (size_t i = 0; i < hists.size(); i++)
+    {
+        same += (lm[i] == gd[i]);
+        agree += ((lm[i] < ESIGNIF) == (gd[i] < ESIGNIF));
+
+        /* Difference in orders of magnitude */
+        if (lm[i] > 0 && gd[i] > 0)
+            maxdiff = std::max(maxdiff, std::abs(log10(lm[i]) - log10(gd[i])));
+    }
+
+    std::cout << "log-Weibull fit of " << hists.size() << " spectra" << std::endl << std::endl;
+    std::cout << std::setw(24) << "" << std::setw(16) << "gradient" << std::setw(16) << "LM" << std::endl;
+    std::cout << std::setw(24) << "spectra/s" << std::fixed << std::setprecision(1)
+              << std::setw(16) << gdrate << std::setw(16) << lmrate << std::endl << std::endl;
+
+    std::cout << "identical e-values:      " << same << " (" << std::setprecision(2)
+              << 100.0 * same / hists.size() << "%)" << std::endl;
+    std::cout << "agree on e < " << ESIGNIF << ":      " << agree << " ("
+              << 100.0 * agree / hists.size() << "%)" << std::endl;
+    std::cout << "max |log10 e| diff:      " << std::setprecision(3) << maxdiff << std::endl;
+
+    return status;
+}
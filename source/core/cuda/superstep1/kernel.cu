@@ -32,6 +32,7 @@
 
 #include "cuda/driver.hpp"
 #include "cuda/superstep1/kernel.hpp"
+#include "dslim.h"
 
 // Macro to obtain amino acid masses
 #define PROTONS(z)                 ((PROTON) * (z))
@@ -250,8 +251,26 @@ void SortpepEntries(Index *index, T *h_mz)
 
 // -------------------------------------------------------------------------------------------- //
 
+// functor to encode the sorted fragment-ion positions in ENCODEION format
+struct encodeIon
+{
+    const uint_t speclen;
+    const uint_t peplen_1;
+    const uint_t maxz;
+
+    encodeIon(uint_t _speclen, uint_t _peplen_1, uint_t _maxz) : speclen(_speclen), peplen_1(_peplen_1), maxz(_maxz) {}
+
+    __host__ __device__
+    uint_t operator()(uint_t k) const
+    {
+        return ENCODESPECION(k, speclen, peplen_1, maxz);
+    }
+};
+
+// -------------------------------------------------------------------------------------------- //
+
 // stable sort fragment-ion data on GPU
-__host__ void StableKeyValueSort(uint_t *d_keys, uint_t* h_data, int size, bool isSearch)
+__host__ void StableKeyValueSort(uint_t *d_keys, uint_t* h_data, int size, uint_t speclen, uint_t peplen_1, uint_t maxz, bool isSearch)
 {
     auto driver = hcp::gpu::cuda::driver::get_instance();
 
@@ -264,6 +283,9 @@ __host__ void StableKeyValueSort(uint_t *d_keys, uint_t* h_data, int size, bool
     // sort the data using keys
     thrust::stable_sort_by_key(thrust::device.on(driver->get_stream()), d_keys, d_keys + size, d_data);
 
+    // encode the sorted positions as [peptide ID | isY | charge]
+    thrust::transform(thrust::device.on(driver->get_stream()), d_data, d_data + size, d_data, encodeIon(speclen, peplen_1, maxz));
+
     if (!isSearch)
         // copy sorted data to host array
         hcp::gpu::cuda::error_check(D2H(h_data, d_data, size, driver->stream[0]));
@@ -548,7 +570,7 @@ __host__ status_t ConstructIndexChunk(Index *index, int_t chunk_number, bool isS
     uint_t *iAPtr = index->ionIndex[chunk_number].iA;
 
     // Stable keyValue sort the fragment-ion data and copy to iAPtr
-    StableKeyValueSort(d_fragIon, iAPtr, iAsize, isSearch);
+    StableKeyValueSort(d_fragIon, iAPtr, iAsize, speclen, peplen_1, maxz, isSearch);
 
     if (!isSearch)
         // construct corresponding DSLIM.bA
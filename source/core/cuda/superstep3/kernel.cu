@@ -669,7 +669,6 @@ __global__ void SpSpGEMM(spectype_t *dQ_moz, spectype_t *dQ_intensity, uint_t *d
     auto *QAPtr = dQ_moz + dQ_idx[qnum];
     auto *iPtr = dQ_intensity + dQ_idx[qnum];
     int qspeclen = dQ_idx[qnum + 1] - dQ_idx[qnum];
-    int halfspeclen = speclen / 2;
 
     int minlimit = dQ_minlimits[qnum];
     int maxlimit = dQ_maxlimits[qnum] - 1; // maxlimit = upper_bound - 1
@@ -710,8 +709,8 @@ __global__ void SpSpGEMM(spectype_t *dQ_moz, spectype_t *dQ_intensity, uint_t *d
             if (n < 1)
                 continue;
 
-            int off1 = lower_bound(data, n, (uint_t)(minlimit * speclen)) - data;
-            int off2 = upper_bound(data, n, (uint_t)(((maxlimit + 1) * speclen) - 1)) - data;
+            int off1 = lower_bound(data, n, (uint_t)ENCODEION(minlimit, 0, 0)) - data;
+            int off2 = upper_bound(data, n, (uint_t)(ENCODEION(maxlimit + 1, 0, 0) - 1)) - data;
 
             int stt = d_bA[bin] + off1;
             int ends = d_bA[bin] + off2;
@@ -734,11 +733,11 @@ __global__ void SpSpGEMM(spectype_t *dQ_moz, spectype_t *dQ_intensity, uint_t *d
                 {
                     uint_t raw = d_iA[ion];
 
-                    /* Calculate the residue (raw % speclen) and isY */
-                    short isY = (((raw % speclen)) / halfspeclen);
+                    /* Extract isY from the encoded ion */
+                    short isY = IONISY(raw);
 
                     // key = parent peptide ID
-                    myKey = (raw / speclen);
+                    myKey = IONPEPID(raw);
 
                     // write to keys
                     keys[threadIdx.x] = myKey;
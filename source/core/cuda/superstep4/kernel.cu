@@ -573,7 +573,6 @@ __host__ status_t processResults(Index *index, Queries<spectype_t> *gWorkPtr, in
             psm.hyperscore = h_topscore[s].hyperscore;
             psm.sharedions = h_topscore[s].sharedions;
             psm.psid = h_topscore[s].psid;
-            psm.totalions = (index[psm.idxoffset].pepIndex.peplen - 1) * params.maxz * iSERIES;
             psm.rtime = gWorkPtr->rtimes[s];
             psm.pchg = gWorkPtr->charges[s];
             psm.fileIndex = gWorkPtr->fileNum;
@@ -652,7 +651,6 @@ __host__ status_t getIResults(Index *index, Queries<spectype_t> *gWorkPtr, int c
             psm.hyperscore = h_topscore[s].hyperscore;
             psm.sharedions = h_topscore[s].sharedions;
             psm.psid = h_topscore[s].psid;
-            psm.totalions = (index[psm.idxoffset].pepIndex.peplen - 1) * params.maxz * iSERIES;
             psm.rtime = gWorkPtr->rtimes[s];
             psm.pchg = gWorkPtr->charges[s];
             psm.fileIndex = gWorkPtr->fileNum;
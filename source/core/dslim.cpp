@@ -49,11 +49,10 @@ status_t DSLIM_Construct(Index *index)
 
 
     uint_t threads = params.threads;
-    uint_t maxz = params.maxz;
-    uint_t peplen_1 = index->pepIndex.peplen - 1;
 
-    double_t maxmass = params.max_mass;
-    uint_t scale = params.scale;
+    /* The fragment charge must fit in the iA encoding */
+    if (params.maxz > (1u << IONCHGBITS))
+        status = ERR_INVLD_PARAM;
 
     // allocate memory to temporarily store the fragment ion data
     if (status == SLM_SUCCESS && SpecArr == NULL
@@ -101,53 +100,16 @@ status_t DSLIM_Construct(Index *index)
         }
     }
 
-
-    // construct bA on the CPU
-    if (status == SLM_SUCCESS && !params.useGPU)
+    // sample the iA into the skip directories
+    if (status == SLM_SUCCESS)
     {
-        const uint_t speclen = peplen_1 * maxz * iSERIES;
-
-        /* Construct DSLIM.bA */
-#ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
-#endif /* USE_OMP */
-        for (uint_t chunk_number = 0; chunk_number < index->nChunks; chunk_number++)
-        {
-            uint_t *bAPtr = index->ionIndex[chunk_number].bA;
-
-            /* Get size of the chunk */
-            uint_t csize = ((chunk_number == index->nChunks - 1) && (index->nChunks > 1)) ?
-                           index->lastchunksize                                 :
-                           index->chunksize;
-
-            uint_t count = bAPtr[0];
-
-            /* Initialize first and last bA entries */
-            bAPtr[0] = 0;
-
-            for (uint_t li = 1; li <= (uint_t)(maxmass * scale); li++)
-            {
-                uint_t tmpcount = bAPtr[li];
-                bAPtr[li] = bAPtr[li - 1] + count;
-                count = tmpcount;
-            }
-
-            /* Check if all correctly done */
-            if (bAPtr[(int_t)(maxmass * scale)] != (csize * speclen))
-            {
-                status = ERR_INVLD_SIZE;
-            }
-
-            assert (bAPtr[(int_t)(maxmass * scale)] == (csize * speclen));
-        }
+        for (uint_t chunk_number = 0; chunk_number < index->nChunks && status == SLM_SUCCESS; chunk_number++)
+            status = DSLIM_SkipDirectory(index, chunk_number);
     }
 
-    // stablize the iA data
-    if (status == SLM_SUCCESS && !params.useGPU)
-    {
-        for (uint_t chunk_number = 0; chunk_number < index->nChunks; chunk_number++)
-            status = DSLIM_Optimize(index, chunk_number);
-    }
+    // bucket the precursor masses
+    if (status == SLM_SUCCESS)
+        status = DSLIM_MassDirectory(index);
 
     return status;
 }
@@ -200,7 +162,10 @@ status_t DSLIM_AllocateMemory(Index *index)
                 /* Total Number of Ions = peps * #ion series * ions/ion series */
                 index->ionIndex[i].iA = new uint_t[(size * speclen)];
 
-                if (index->ionIndex[i].iA == NULL)
+                /* Skip directory for the iA */
+                index->ionIndex[i].sA = new uint_t[SKIPSIZE(size * speclen)];
+
+                if (index->ionIndex[i].iA == NULL || index->ionIndex[i].sA == NULL)
                     status = ERR_INVLD_MEMORY;
 
             }
@@ -242,24 +207,6 @@ status_t DSLIM_ConstructChunk(uint_t threads, Index *index, uint_t chunk_number)
     /* Check if this chunk is the last chunk */
     bool lastChunk = (chunk_number == (index->nChunks - 1))? true: false;
 
-    uint_t *BAPtrs[threads];
-    uint_t *bA = new uint_t[(int_t)(threads * scale * maxmass)];
-
-#ifdef USE_OMP
-
-    for (uint_t i = 0; i < threads; i++)
-        BAPtrs[i] = bA + (int_t)(i * scale * maxmass);
-
-        /* Clear the bAPtrs and SAPtrs */
-#pragma omp parallel for num_threads(threads) schedule (static)
-    for (uint_t i = 0; i < threads; i++)
-        std::memset(BAPtrs[i], 0x0, (scale * maxmass * sizeof(uint_t)));
-#else
-
-    std::memset(index->ionIndex[chunk_number].bA, 0x0, (((params.scale * params.max_mass) + 1) * sizeof(uint_t)));
-
-#endif /* USE_OMP */
-
     if (status == SLM_SUCCESS)
     {
         uint_t start_idx = chunk_number * index->chunksize;
@@ -270,101 +217,76 @@ status_t DSLIM_ConstructChunk(uint_t threads, Index *index, uint_t chunk_number)
             interval = index->lastchunksize;
 
 #ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+#pragma omp parallel num_threads(threads)
 #endif /* USE_OMP */
-        for (uint_t k = start_idx; k < (start_idx + interval); k++)
         {
-            /* Filling point */
-            uint_t nfilled = (k - start_idx) * speclen;
-
-            /* Temporary Array needed for Theoretical Spectra */
-            uint_t* Spectrum = new uint_t[speclen];
+            /* Per-thread scratch for the ion ladders of all charges */
+            std::vector<float_t> ladder(iSERIES * params.maxz);
 
 #ifdef USE_OMP
-            uint_t *bAPtr  = BAPtrs[omp_get_thread_num()];
-#else
-            uint_t *bAPtr = index->ionIndex[chunk_number].bA;
-#endif /* OPENMP */
+#pragma omp for schedule(dynamic, 1)
+#endif /* USE_OMP */
+            for (uint_t k = start_idx; k < (start_idx + interval); k++)
+            {
+                /* Filling point */
+                uint_t nfilled = (k - start_idx) * speclen;
 
-            /* Extract peptide Information */
-            float_t pepMass = 0.0;
-            char_t *seq = NULL;
-            uint_t pepID = k;
+                /* Generate the theoretical spectrum in place */
+                uint_t *Spectrum = &SpecArr[nfilled];
 
-            /* Extract from pepEntries */
-            pepEntry *entry = index->pepEntries + pepID;
+                /* Extract peptide Information */
+                float_t pepMass = 0.0;
+                char_t *seq = NULL;
+                uint_t pepID = k;
 
-            seq = &index->pepIndex.seqs[entry->seqID * peplen];
+                /* Extract from pepEntries */
+                pepEntry *entry = index->pepEntries + pepID;
 
-            /* Check if pepID belongs to peps or mods */
-            if (entry->sites.modNum == 0)
-            {
-                /* Generate the Theoretical Spectrum */
-                pepMass = UTILS_GenerateSpectrum(seq, peplen, Spectrum);
-            }
-            else
-            {
-                /* Generate the Mod. Theoretical Spectrum */
-                pepMass = UTILS_GenerateModSpectrum(seq, (uint_t) peplen, Spectrum, entry->sites);
-            }
+                seq = &index->pepIndex.seqs[entry->seqID * peplen];
 
-            /* If a legal peptide */
-            if (pepMass >= minmass && pepMass <= maxmass)
-            {
-                /* Fill the ions */
-                for (uint_t ion = 0; ion < speclen; ion++)
+                /* Generate the (Mod.) Theoretical Spectrum */
+                pepMass = UTILS_GenerateSpectrum(seq, peplen, Spectrum, entry->sites, ladder.data());
+
+                /* If a legal peptide */
+                if (pepMass >= minmass && pepMass <= maxmass)
                 {
-                    /* Check if legal ion */
-                    if (Spectrum[ion] >= (maxmass * scale))
+                    /* Clip the ions */
+                    for (uint_t ion = 0; ion < speclen; ion++)
                     {
-                        Spectrum[ion] = (maxmass * scale) - 1;
-                        //assert (Spectrum[ion] < (maxmass * scale));
+                        /* Check if legal ion */
+                        if (Spectrum[ion] >= (maxmass * scale))
+                        {
+                            Spectrum[ion] = (maxmass * scale) - 1;
+                        }
                     }
-
-                    SpecArr[nfilled + ion] = Spectrum[ion]; // Fill in the ion
-                    bAPtr[Spectrum[ion]]++; // Update the bA counter
                 }
-            }
 
-            /* Illegal peptide, fill in the container with zeros */
-            else
-            {
-                /* Fill zeros for illegal peptides
-                 * FIXME: Should not be filled into the chunk
-                 *  and be removed from peptide index as well
-                 */
-                std::memset(&SpecArr[nfilled], 0x0, sizeof(uint_t) * speclen);
-                bAPtr[0] += speclen; // Update the BA counter
+                /* Illegal peptide, fill in the container with zeros */
+                else
+                {
+                    /* Fill zeros for illegal peptides
+                     * FIXME: Should not be filled into the chunk
+                     *  and be removed from peptide index as well
+                     */
+                    std::memset(Spectrum, 0x0, sizeof(uint_t) * speclen);
+                }
             }
         }
-
-#ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule (static)
-        for (uint_t i = 0; i < (uint_t)(maxmass * scale); i++)
-        {
-            /* Initialize to zero */
-            index->ionIndex[chunk_number].bA[i] = 0;
-
-            for (uint_t j = 0; j < threads; j++)
-                index->ionIndex[chunk_number].bA[i] += BAPtrs[j][i];
-
-        }
-#endif /* USE_OMP */
-
     }
 
-#ifdef USE_OMP
-    delete[] bA;
-    bA = NULL;
-#endif /* OPENMP */
-
     return status;
 }
 
 /*
  * FUNCTION: DSLIM_SLMTransform
  *
- * DESCRIPTION: Constructs SLIM Transform
+ * DESCRIPTION: Constructs SLIM Transform. The fragment-ions in the
+ *              SpecArr are bucket (counting) sorted into the iA in two
+ *              stable scatter passes: first into coarse buckets of
+ *              SCATTERBINS bins each and then, one coarse bucket per
+ *              thread, into the final bins. The bA is filled in with
+ *              the bin offsets along the way. The final pass writes
+ *              each ion in the ENCODEION format.
  *
  * INPUT:
  * @threads     : Number of parallel threads
@@ -381,22 +303,126 @@ status_t DSLIM_SLMTransform(uint_t threads, Index *index, uint_t chunk_number)
     uint_t size = ((chunk_number == index->nChunks - 1) && (index->nChunks > 1))?
                    index->lastchunksize : index->chunksize;
 
-    uint_t speclen = (index->pepIndex.peplen - 1) * params.maxz * iSERIES;
+    const uint_t peplen_1 = index->pepIndex.peplen - 1;
+    const uint_t maxz = params.maxz;
+    uint_t speclen = peplen_1 * maxz * iSERIES;
     uint_t *iAPtr = index->ionIndex[chunk_number].iA;
+    uint_t *bAPtr = index->ionIndex[chunk_number].bA;
     uint_t iAsize = size * speclen;
 
+    const uint_t nbins = params.max_mass * params.scale;
+    const uint_t ncoarse = (nbins + SCATTERBINS - 1) / SCATTERBINS;
+
+#if !defined(USE_OMP)
+    threads = 1;
+#endif /* USE_OMP */
+
+    /* Contiguous (ordered) blocks of SpecArr, one per thread */
+    const uint_t nblocks = std::max(1u, threads);
+    auto blockStart = [&](uint_t blk) { return (uint_t)(((ull_t) iAsize * blk) / nblocks); };
+
+    /* Coarse bucket histogram per block */
+    uint_t *cHist = new uint_t[nblocks * ncoarse];
+    uint_t *cStart = new uint_t[ncoarse + 1];
+
+    if (cHist == NULL || cStart == NULL)
+        status = ERR_BAD_MEM_ALLOC;
+
+    if (status == SLM_SUCCESS)
+    {
+        std::memset(cHist, 0x0, sizeof(uint_t) * nblocks * ncoarse);
+
+        /* Count the ions per coarse bucket */
 #ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule(static)
+#pragma omp parallel for num_threads(threads) schedule(static, 1)
+#endif /* USE_OMP */
+        for (uint_t blk = 0; blk < nblocks; blk++)
+        {
+            uint_t *hist = cHist + (blk * ncoarse);
+
+            for (uint_t k = blockStart(blk); k < blockStart(blk + 1); k++)
+                hist[SpecArr[k] / SCATTERBINS]++;
+        }
+
+        /* Exclusive prefix sum in (bucket, block) order for stable scatter */
+        uint_t offset = 0;
+
+        for (uint_t cb = 0; cb < ncoarse; cb++)
+        {
+            cStart[cb] = offset;
+
+            for (uint_t blk = 0; blk < nblocks; blk++)
+            {
+                uint_t count = cHist[(blk * ncoarse) + cb];
+                cHist[(blk * ncoarse) + cb] = offset;
+                offset += count;
+            }
+        }
+
+        cStart[ncoarse] = offset;
+
+        /* Scatter the ions into their coarse buckets */
+#ifdef USE_OMP
+#pragma omp parallel for num_threads(threads) schedule(static, 1)
 #endif /* USE_OMP */
-    for (uint_t k = 0; k < iAsize; k++)
-        iAPtr[k] = k;
+        for (uint_t blk = 0; blk < nblocks; blk++)
+        {
+            uint_t *cursor = cHist + (blk * ncoarse);
+
+            for (uint_t k = blockStart(blk); k < blockStart(blk + 1); k++)
+                iAPtr[cursor[SpecArr[k] / SCATTERBINS]++] = k;
+        }
 
+        /* Scatter each coarse bucket into its bins and fill the bA */
 #ifdef USE_OMP
-    /* Parallel Key Value Sort */
-    KeyVal_Parallel<uint_t>(SpecArr, iAPtr, iAsize, threads);
-#else
-    KeyVal_Serial<uint_t>(SpecArr, iAPtr, iAsize);
+#pragma omp parallel num_threads(threads)
+#endif /* USE_OMP */
+        {
+            std::vector<uint_t> scratch;
+            uint_t cursor[SCATTERBINS];
+
+#ifdef USE_OMP
+#pragma omp for schedule(dynamic, 1)
 #endif /* USE_OMP */
+            for (uint_t cb = 0; cb < ncoarse; cb++)
+            {
+                uint_t first = cb * SCATTERBINS;
+                uint_t nb = std::min(SCATTERBINS, nbins - first);
+
+                std::memset(cursor, 0x0, sizeof(uint_t) * SCATTERBINS);
+
+                for (uint_t ion = cStart[cb]; ion < cStart[cb + 1]; ion++)
+                    cursor[SpecArr[iAPtr[ion]] - first]++;
+
+                uint_t binoff = cStart[cb];
+
+                for (uint_t bin = 0; bin < nb; bin++)
+                {
+                    uint_t count = cursor[bin];
+                    bAPtr[first + bin] = binoff;
+                    cursor[bin] = binoff;
+                    binoff += count;
+                }
+
+                scratch.assign(iAPtr + cStart[cb], iAPtr + cStart[cb + 1]);
+
+                for (auto &k : scratch)
+                    iAPtr[cursor[SpecArr[k] - first]++] = ENCODESPECION(k, speclen, peplen_1, maxz);
+            }
+        }
+
+        bAPtr[nbins] = cStart[ncoarse];
+
+        /* Check if all correctly done */
+        if (bAPtr[nbins] != iAsize)
+            status = ERR_INVLD_SIZE;
+    }
+
+    if (cHist != NULL)
+        delete[] cHist;
+
+    if (cStart != NULL)
+        delete[] cStart;
 
     return status;
 }
@@ -428,20 +454,64 @@ status_t DSLIM_InitializeScorecard(Index *index, uint_t idxs)
 #endif /* USE_OMP */
         for (uint_t thd = 0; thd < params.threads; thd++)
         {
-            Score[thd].byc = new BYC[sAize];
-            memset(Score[thd].byc, 0x0, sizeof(BYC) * sAize);
+            Score[thd].byc = new scEntry[sAize];
+            memset(Score[thd].byc, 0x0, sizeof(scEntry) * sAize);
+
+            /* Touched list of the sparse windows only */
+            Score[thd].mtouched = SCTOUCHED(sAize);
+            Score[thd].touched = new uint_t[Score[thd].mtouched];
+            Score[thd].ntouched = 0;
+
+            /* Hit buffers of the blocks of a SCATTERWIN window. No
+             * window of the smaller chunks takes the blocked scatter */
+            if (sAize >= SCATTERWIN)
+            {
+                Score[thd].hits = new BYHit[SCBLOCKS(SCATTERWIN) * SCHITS];
+                Score[thd].nhits = new uint_t[SCBLOCKS(SCATTERWIN)];
+                memset(Score[thd].nhits, 0x0, sizeof(uint_t) * SCBLOCKS(SCATTERWIN));
+            }
 
             /* Initialize the histogram */
             Score[thd].res.survival = new double_t[1 + (MAX_HYPERSCORE * 10) + 1]; // +2 for accumulation
 
-            /* Evaluate to the nearest power of 2 */
-            uint_t num = (params.topmatches == 0)? 1: params.topmatches;
-            num = (uint_t)(floor(log2(num) + 0.999));
-
             std::memset(Score[thd].res.survival, 0x0, sizeof (double_t) * (2 + MAX_HYPERSCORE * 10));
 
-            /* Initialize the heap with size = pow(2, num) - 1 */
-            Score[thd].res.topK.init((1 << num) - 1);
+            /* Initialize the heap to keep the top matches (at least 1) */
+            Score[thd].res.topK.init(std::max(params.topmatches, (uint_t)1));
+
+            /* Results of a query group in the chunk-major traversal */
+            if (params.chunkmajor)
+            {
+                Score[thd].gres = new Results[QGROUPSIZE];
+
+                for (uint_t q = 0; q < QGROUPSIZE; q++)
+                {
+                    Score[thd].gres[q].survival = new double_t[2 + MAX_HYPERSCORE * 10];
+                    std::memset(Score[thd].gres[q].survival, 0x0, sizeof (double_t) * (2 + MAX_HYPERSCORE * 10));
+
+                    Score[thd].gres[q].topK.init(std::max(params.topmatches, (uint_t)1));
+                }
+            }
+
+            /* Prefilter shortlists and rescoring scratch of the two-stage search */
+            if (params.prefilter)
+            {
+                uint_t npres = (params.chunkmajor) ? QGROUPSIZE : 1;
+
+                Score[thd].pres = new Results[npres];
+
+                for (uint_t q = 0; q < npres; q++)
+                {
+                    Score[thd].pres[q].survival = new double_t[2 + MAX_HYPERSCORE * 10];
+                    std::memset(Score[thd].pres[q].survival, 0x0, sizeof (double_t) * (2 + MAX_HYPERSCORE * 10));
+
+                    Score[thd].pres[q].topK.init(params.pfkeep);
+                }
+
+                Score[thd].pcells = new hCell[params.pfkeep];
+                Score[thd].spec = new uint_t[iSERIES * params.maxz * MAX_SEQ_LEN];
+                Score[thd].ladder = new float_t[iSERIES * params.maxz];
+            }
         }
     }
     else
@@ -459,45 +529,111 @@ status_t DSLIM_InitializeScorecard(Index *index, uint_t idxs)
 }
 
 /*
- * FUNCTION: DSLIM_Optimize
+ * FUNCTION: DSLIM_SkipDirectory
  *
- * DESCRIPTION: Optimization of the index
+ * DESCRIPTION: Sample every SKIPSTRIDE'th iA entry into the
+ *              skip directory (sA) so that the bins can be
+ *              clipped without binary searching the iA
  *
  * INPUT:
- * @threads     : Number of parallel threads
  * @index       : The SLM Index
  * @chunk_number: Chunk Index
  *
  * OUTPUT:
  * @status: Status of execution
  */
-status_t DSLIM_Optimize(Index *index, uint_t chunk_number)
+status_t DSLIM_SkipDirectory(Index *index, uint_t chunk_number)
 {
     status_t status = SLM_SUCCESS;
 
     uint_t *iAPtr = index->ionIndex[chunk_number].iA;
-    uint_t *bAPtr = index->ionIndex[chunk_number].bA;
+    uint_t *sAPtr = index->ionIndex[chunk_number].sA;
 
-#ifdef USE_OMP
-    uint_t interval = 50 *params.scale;
-    uint_t threads = params.threads;
-#endif /* USE_OMP */
+    /* Get size of the chunk */
+    uint_t csize = ((chunk_number == index->nChunks - 1) && (index->nChunks > 1)) ?
+                   index->lastchunksize : index->chunksize;
+
+    uint_t speclen = (index->pepIndex.peplen - 1) * params.maxz * iSERIES;
+    uint_t sAsize = SKIPSIZE(csize * speclen);
+
+    if (iAPtr == NULL || sAPtr == NULL)
+        status = ERR_INVLD_MEMORY;
 
+    if (status == SLM_SUCCESS)
+    {
 #ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule(dynamic, interval)
+#pragma omp parallel for num_threads(params.threads) schedule(static)
 #endif /* USE_OMP */
-    /* Stablize the entries in iAPtr */
-    for (uint_t kk = 0; kk < (params.max_mass * params.scale); kk++)
+        for (uint_t k = 0; k < sAsize; k++)
+            sAPtr[k] = iAPtr[k * SKIPSTRIDE];
+    }
+
+    return status;
+}
+
+/*
+ * FUNCTION: DSLIM_MassDirectory
+ *
+ * DESCRIPTION: Copy the precursor masses of the pepEntries
+ *              into a contiguous array, bucket them into
+ *              a direct-mapped directory of MASSBKTS per Da
+ *              and record the peptide range of each chunk
+ *              so that a precursor mass window is located
+ *              with an O(1) lookup and a short scan
+ *
+ * INPUT:
+ * @index: The SLM Index
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t DSLIM_MassDirectory(Index *index)
+{
+    status_t status = SLM_SUCCESS;
+
+    const uint_t count = index->lcltotCnt;
+    pepEntry *entries = index->pepEntries;
+
+    if (entries == NULL || count == 0 || index->ionIndex == NULL)
+        status = ERR_INVLD_MEMORY;
+
+    if (status == SLM_SUCCESS)
     {
-        uint_t offset = bAPtr[kk];
-        uint_t size = bAPtr[kk + 1] - offset;
+        delete[] index->pepMass;
+        delete[] index->massDir;
+
+        index->pepMass = new float_t[count];
+
+        for (uint_t i = 0; i < count; i++)
+            index->pepMass[i] = entries[i].Mass;
+
+        /* One bucket past the heaviest peptide */
+        const int_t nbkts = std::max(MASSBUCKET(index->pepMass[count - 1]), 0) + 1;
 
-        if (size > 1)
+        index->nmassDir = nbkts;
+        index->massDir = new uint_t[nbkts + 1];
+
+        /* massDir[b] = first entry with bucket >= b */
+        uint_t i = 0;
+
+        for (int_t b = 0; b <= nbkts; b++)
         {
-            /* Stablize the KeyVal Sort */
-            UTILS_Sort<uint_t>((iAPtr + offset), size, false);
+            while (i < count && MASSBUCKET(index->pepMass[i]) < b)
+                i++;
+
+            index->massDir[b] = i;
         }
 
+        index->minMass = index->pepMass[0];
+        index->maxMass = index->pepMass[count - 1];
+
+        /* Chunks hold consecutive runs of chunksize pepEntries */
+        for (uint_t chno = 0; chno < index->nChunks; chno++)
+        {
+            index->ionIndex[chno].pepoffset = chno * index->chunksize;
+            index->ionIndex[chno].npeps = ((chno == index->nChunks - 1) && (index->nChunks > 1)) ?
+                                          index->lastchunksize : index->chunksize;
+        }
     }
 
     return status;
@@ -678,8 +814,8 @@ status_t DSLIM_Deinitialize(Index *index)
 
 status_t DSLIM_DeallocateIonIndex(Index *index)
 {
-    /* Deallocate all the DSLIM chunks */
-    for (uint_t chno = 0; chno < index->nChunks; chno++)
+    /* Deallocate all the DSLIM chunks (unless memory mapped) */
+    for (uint_t chno = 0; chno < index->nChunks && index->mmapaddr == NULL; chno++)
     {
         spmat_t curr_chunk = index->ionIndex[chno];
 
@@ -694,6 +830,12 @@ status_t DSLIM_DeallocateIonIndex(Index *index)
             delete[] curr_chunk.iA;
             curr_chunk.iA = NULL;
         }
+
+        if (curr_chunk.sA != NULL)
+        {
+            delete[] curr_chunk.sA;
+            curr_chunk.sA = NULL;
+        }
     }
 
     if (index->ionIndex != NULL)
@@ -714,12 +856,29 @@ status_t DSLIM_DeallocateIonIndex(Index *index)
 
 status_t DSLIM_DeallocatePepIndex(Index *index)
 {
+    /* Unmap the index cache file if loaded from it */
+    if (index->mmapaddr != NULL)
+        DSLIM_UnmapIndexCache(index);
+
     if (index->pepEntries != NULL)
     {
         delete[] index->pepEntries;
         index->pepEntries = NULL;
     }
 
+    if (index->pepMass != NULL)
+    {
+        delete[] index->pepMass;
+        index->pepMass = NULL;
+    }
+
+    if (index->massDir != NULL)
+    {
+        delete[] index->massDir;
+        index->massDir = NULL;
+        index->nmassDir = 0;
+    }
+
     if (index->pepIndex.seqs != NULL)
     {
         delete[] index->pepIndex.seqs;
@@ -787,11 +946,55 @@ status_t DSLIM_DeallocateSC()
             if (Score[thd].byc)
                 delete[] Score[thd].byc;
 
+            if (Score[thd].touched)
+                delete[] Score[thd].touched;
+
             if (Score[thd].res.survival)
                 delete[] Score[thd].res.survival;
 
+            if (Score[thd].hits)
+                delete[] Score[thd].hits;
+
+            if (Score[thd].nhits)
+                delete[] Score[thd].nhits;
+
+            if (Score[thd].gres)
+            {
+                for (uint_t q = 0; q < QGROUPSIZE; q++)
+                    delete[] Score[thd].gres[q].survival;
+
+                delete[] Score[thd].gres;
+            }
+
+            if (Score[thd].pres)
+            {
+                uint_t npres = (params.chunkmajor) ? QGROUPSIZE : 1;
+
+                for (uint_t q = 0; q < npres; q++)
+                    delete[] Score[thd].pres[q].survival;
+
+                delete[] Score[thd].pres;
+            }
+
+            if (Score[thd].pcells)
+                delete[] Score[thd].pcells;
+
+            if (Score[thd].spec)
+                delete[] Score[thd].spec;
+
+            if (Score[thd].ladder)
+                delete[] Score[thd].ladder;
+
             Score[thd].byc = NULL;
+            Score[thd].touched = NULL;
             Score[thd].res.survival = NULL;
+            Score[thd].gres = NULL;
+            Score[thd].hits = NULL;
+            Score[thd].nhits = NULL;
+            Score[thd].pres = NULL;
+            Score[thd].pcells = NULL;
+            Score[thd].spec = NULL;
+            Score[thd].ladder = NULL;
         }
 
         delete[] Score;
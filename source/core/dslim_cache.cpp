@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2019 Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include "dslim.h"
+
+using namespace std;
+
+extern gParams params;
+
+/* Static function Prototypes */
+static inline ull_t DSLIM_CacheAlign(ull_t offset);
+static status_t DSLIM_CacheHeader(Index *index, string_t &dbfile, slmIdxHeader &hdr);
+static ull_t DSLIM_CacheLayout(slmIdxHeader &hdr, ull_t *chunkoffs);
+
+static inline ull_t DSLIM_CacheAlign(ull_t offset)
+{
+    return ((offset + SLMIDX_ALIGN - 1) / SLMIDX_ALIGN) * SLMIDX_ALIGN;
+}
+
+/*
+ * FUNCTION: DSLIM_CacheHeader
+ *
+ * DESCRIPTION: Fill the index cache header with the current
+ *              parameters and the database file stamp
+ *
+ * INPUT:
+ * @index : The SLM Index
+ * @dbfile: Path to the database (*.peps) file
+ * @hdr   : The header to fill
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+static status_t DSLIM_CacheHeader(Index *index, string_t &dbfile, slmIdxHeader &hdr)
+{
+    struct stat dbstat;
+
+    std::memset(&hdr, 0x0, sizeof(slmIdxHeader));
+
+    std::memcpy(hdr.magic, SLMIDX_MAGIC, sizeof(hdr.magic));
+    hdr.version   = SLMIDX_VERSION;
+    hdr.hdrsize   = sizeof(slmIdxHeader);
+    hdr.entrysize = sizeof(pepEntry);
+
+    hdr.peplen    = index->pepIndex.peplen;
+    hdr.maxz      = params.maxz;
+    hdr.scale     = params.scale;
+    hdr.min_mass  = params.min_mass;
+    hdr.max_mass  = params.max_mass;
+    hdr.policy    = (uint_t) params.policy;
+    hdr.nodes     = params.nodes;
+    hdr.myid      = params.myid;
+
+    hdr.vmods_per_pep = params.vModInfo.vmods_per_pep;
+    hdr.num_vars      = params.vModInfo.num_vars;
+
+    for (uint_t i = 0; i < params.vModInfo.num_vars && i < MAX_MOD_TYPES; i++)
+        hdr.modMass[i] = params.vModInfo.vmods[i].modMass;
+
+    std::strncpy(hdr.modconditions, params.modconditions.c_str(), sizeof(hdr.modconditions) - 1);
+
+    /* Stamp the database file */
+    if (stat(dbfile.c_str(), &dbstat) != 0)
+        return ERR_FILE_NOT_FOUND;
+
+    hdr.dbsize  = (ull_t) dbstat.st_size;
+    hdr.dbmtime = (longlong_t) dbstat.st_mtime;
+
+    return SLM_SUCCESS;
+}
+
+/*
+ * FUNCTION: DSLIM_CacheLayout
+ *
+ * DESCRIPTION: Compute the section offsets in the index cache file
+ *
+ * INPUT:
+ * @hdr      : The index cache header (shape must be filled)
+ * @chunkoffs: Array[nChunks + 1] to fill in the chunk offsets
+ *
+ * OUTPUT:
+ * @filesize: Total size of the index cache file
+ */
+static ull_t DSLIM_CacheLayout(slmIdxHeader &hdr, ull_t *chunkoffs)
+{
+    const ull_t speclen = (hdr.peplen - 1) * hdr.maxz * iSERIES;
+    const ull_t bAsize = ((ull_t) hdr.max_mass * hdr.scale) + 1;
+
+    ull_t offset = DSLIM_CacheAlign(sizeof(slmIdxHeader));
+
+    /* pepEntries */
+    offset = DSLIM_CacheAlign(offset + ((ull_t) hdr.lcltotCnt * sizeof(pepEntry)));
+
+    /* pepIndex.seqs */
+    offset = DSLIM_CacheAlign(offset + (ull_t) hdr.AAs);
+
+    /* bA and iA of each chunk */
+    for (uint_t chno = 0; chno < hdr.nChunks; chno++)
+    {
+        ull_t csize = ((chno == hdr.nChunks - 1) && (hdr.nChunks > 1)) ?
+                       hdr.lastchunksize : hdr.chunksize;
+
+        chunkoffs[chno] = offset;
+
+        offset = DSLIM_CacheAlign(offset + (bAsize * sizeof(uint_t)));
+        offset = DSLIM_CacheAlign(offset + (csize * speclen * sizeof(uint_t)));
+        offset = DSLIM_CacheAlign(offset + (SKIPSIZE(csize * speclen) * sizeof(uint_t)));
+    }
+
+    chunkoffs[hdr.nChunks] = offset;
+
+    return offset;
+}
+
+string_t DSLIM_IndexCachePath(uint_t peplen)
+{
+    return params.dbpath + "/" + std::to_string(peplen) + "." + std::to_string(params.myid) +
+           "-" + std::to_string(params.nodes) + SLMIDX_EXT;
+}
+
+status_t DSLIM_LoadIndexCache(Index *index, string_t &dbfile)
+{
+    status_t status = SLM_SUCCESS;
+    slmIdxHeader expected;
+    slmIdxHeader hdr;
+    struct stat fstat_;
+    int_t fd = -1;
+
+    const uint_t peplen = index->pepIndex.peplen;
+    const string_t fname = DSLIM_IndexCachePath(peplen);
+
+    /* Index cache is only used for the CPU index */
+    if (params.nodbcache || params.useGPU)
+        return ERR_INVLD_PARAM;
+
+    status = DSLIM_CacheHeader(index, dbfile, expected);
+
+    if (status == SLM_SUCCESS)
+    {
+        fd = open(fname.c_str(), O_RDONLY);
+
+        if (fd < 0)
+            status = ERR_FILE_NOT_FOUND;
+    }
+
+    /* Read and verify the header */
+    if (status == SLM_SUCCESS)
+    {
+        if (pread(fd, &hdr, sizeof(slmIdxHeader), 0) != (ssize_t) sizeof(slmIdxHeader))
+            status = ERR_FILE_ERROR;
+    }
+
+    if (status == SLM_SUCCESS)
+    {
+        if (std::strncmp(hdr.magic, expected.magic, sizeof(hdr.magic)) != 0 ||
+            hdr.version       != expected.version   ||
+            hdr.hdrsize       != expected.hdrsize   ||
+            hdr.entrysize     != expected.entrysize ||
+            hdr.peplen        != expected.peplen    ||
+            hdr.maxz          != expected.maxz      ||
+            hdr.scale         != expected.scale     ||
+            hdr.min_mass      != expected.min_mass  ||
+            hdr.max_mass      != expected.max_mass  ||
+            hdr.policy        != expected.policy    ||
+            hdr.nodes         != expected.nodes     ||
+            hdr.myid          != expected.myid      ||
+            hdr.vmods_per_pep != expected.vmods_per_pep ||
+            hdr.num_vars      != expected.num_vars  ||
+            hdr.dbsize        != expected.dbsize    ||
+            hdr.dbmtime       != expected.dbmtime   ||
+            std::memcmp(hdr.modMass, expected.modMass, sizeof(hdr.modMass)) != 0 ||
+            std::strncmp(hdr.modconditions, expected.modconditions, sizeof(hdr.modconditions)) != 0)
+        {
+            status = ERR_INVLD_PARAM;
+        }
+    }
+
+    /* The chunking must match what LBE_Distribute would produce */
+    if (status == SLM_SUCCESS)
+    {
+        uint_t speclen = (peplen - 1) * params.maxz * iSERIES;
+        uint_t chunksize = std::min(hdr.lcltotCnt, (uint_t)(MAX_IONS / speclen));
+        chunksize = std::min(chunksize, (uint_t)(params.spadmem / (BYISIZE * params.threads)));
+
+        if (hdr.nChunks < 1 || hdr.chunksize != chunksize)
+            status = ERR_INVLD_SIZE;
+    }
+
+    /* Verify the size of the file */
+    if (status == SLM_SUCCESS)
+    {
+        ull_t *chunkoffs = new ull_t[hdr.nChunks + 1];
+        ull_t filesize = DSLIM_CacheLayout(hdr, chunkoffs);
+
+        if (fstat(fd, &fstat_) != 0 || (ull_t) fstat_.st_size != filesize || hdr.filesize != filesize)
+            status = ERR_INVLD_SIZE;
+
+        /* Map the file read-only and point the Index into it */
+        if (status == SLM_SUCCESS)
+        {
+            void *addr = mmap(NULL, filesize, PROT_READ, MAP_SHARED, fd, 0);
+
+            if (addr == MAP_FAILED)
+                status = ERR_BAD_MEM_ALLOC;
+            else
+            {
+                char_t *base = (char_t *) addr;
+                ull_t offset = DSLIM_CacheAlign(sizeof(slmIdxHeader));
+                const ull_t bAsize = ((ull_t) hdr.max_mass * hdr.scale) + 1;
+                const ull_t speclen = (peplen - 1) * params.maxz * iSERIES;
+
+                index->mmapaddr = addr;
+                index->mmapsize = filesize;
+
+                index->pepCount      = hdr.pepCount;
+                index->modCount      = hdr.modCount;
+                index->totalCount    = hdr.totalCount;
+                index->lclpepCnt     = hdr.lclpepCnt;
+                index->lclmodCnt     = hdr.lclmodCnt;
+                index->lcltotCnt     = hdr.lcltotCnt;
+                index->nChunks       = hdr.nChunks;
+                index->chunksize     = hdr.chunksize;
+                index->lastchunksize = hdr.lastchunksize;
+
+                index->pepIndex.AAs  = hdr.AAs;
+                index->pepEntries    = (pepEntry *)(base + offset);
+
+                offset = DSLIM_CacheAlign(offset + ((ull_t) hdr.lcltotCnt * sizeof(pepEntry)));
+                index->pepIndex.seqs = (AA *)(base + offset);
+
+                index->ionIndex = new spmat_t[hdr.nChunks];
+
+                for (uint_t chno = 0; chno < hdr.nChunks; chno++)
+                {
+                    ull_t csize = ((chno == hdr.nChunks - 1) && (hdr.nChunks > 1)) ?
+                                   hdr.lastchunksize : hdr.chunksize;
+
+                    ull_t iAoff = DSLIM_CacheAlign(chunkoffs[chno] + bAsize * sizeof(uint_t));
+                    ull_t sAoff = DSLIM_CacheAlign(iAoff + csize * speclen * sizeof(uint_t));
+
+                    index->ionIndex[chno].bA = (uint_t *)(base + chunkoffs[chno]);
+                    index->ionIndex[chno].iA = (uint_t *)(base + iAoff);
+                    index->ionIndex[chno].sA = (uint_t *)(base + sAoff);
+                }
+            }
+        }
+
+        delete[] chunkoffs;
+    }
+
+    /* Bucket the precursor masses */
+    if (status == SLM_SUCCESS)
+        status = DSLIM_MassDirectory(index);
+
+    if (fd >= 0)
+        close(fd);
+
+    return status;
+}
+
+status_t DSLIM_WriteIndexCache(Index *index, string_t &dbfile)
+{
+    status_t status = SLM_SUCCESS;
+    slmIdxHeader hdr;
+
+    const uint_t peplen = index->pepIndex.peplen;
+    const string_t fname = DSLIM_IndexCachePath(peplen);
+    const string_t tmpname = fname + ".tmp";
+
+    /* Nothing to write */
+    if (params.nodbcache || params.useGPU || index->mmapaddr != NULL || index->nChunks < 1)
+        return ERR_INVLD_PARAM;
+
+    status = DSLIM_CacheHeader(index, dbfile, hdr);
+
+    if (status == SLM_SUCCESS)
+    {
+        const ull_t speclen = (peplen - 1) * params.maxz * iSERIES;
+        const ull_t bAsize = ((ull_t) params.max_mass * params.scale) + 1;
+        const char_t zeros[SLMIDX_ALIGN] = {};
+
+        hdr.pepCount      = index->pepCount;
+        hdr.modCount      = index->modCount;
+        hdr.totalCount    = index->totalCount;
+        hdr.lclpepCnt     = index->lclpepCnt;
+        hdr.lclmodCnt     = index->lclmodCnt;
+        hdr.lcltotCnt     = index->lcltotCnt;
+        hdr.nChunks       = index->nChunks;
+        hdr.chunksize     = index->chunksize;
+        hdr.lastchunksize = index->lastchunksize;
+        hdr.AAs           = index->pepIndex.AAs;
+
+        ull_t *chunkoffs = new ull_t[hdr.nChunks + 1];
+        hdr.filesize = DSLIM_CacheLayout(hdr, chunkoffs);
+
+        std::ofstream fh(tmpname, ios::out | ios::binary | ios::trunc);
+
+        /* Write a section and pad it to the alignment */
+        auto writeSection = [&](const void *data, ull_t bytes)
+        {
+            fh.write((const char_t *) data, bytes);
+
+            ull_t pad = DSLIM_CacheAlign(fh.tellp()) - (ull_t) fh.tellp();
+
+            if (pad > 0)
+                fh.write(zeros, pad);
+        };
+
+        if (fh.is_open())
+        {
+            writeSection(&hdr, sizeof(slmIdxHeader));
+            writeSection(index->pepEntries, (ull_t) index->lcltotCnt * sizeof(pepEntry));
+            writeSection(index->pepIndex.seqs, (ull_t) index->pepIndex.AAs);
+
+            for (uint_t chno = 0; chno < index->nChunks && fh.good(); chno++)
+            {
+                ull_t csize = ((chno == index->nChunks - 1) && (index->nChunks > 1)) ?
+                               index->lastchunksize : index->chunksize;
+
+                writeSection(index->ionIndex[chno].bA, bAsize * sizeof(uint_t));
+                writeSection(index->ionIndex[chno].iA, csize * speclen * sizeof(uint_t));
+                writeSection(index->ionIndex[chno].sA, SKIPSIZE(csize * speclen) * sizeof(uint_t));
+            }
+
+            if (!fh.good() || (ull_t) fh.tellp() != hdr.filesize)
+                status = ERR_FILE_ERROR;
+
+            fh.close();
+        }
+        else
+        {
+            status = ERR_FILE_ERROR;
+        }
+
+        delete[] chunkoffs;
+
+        /* Atomically replace any older index cache file */
+        if (status == SLM_SUCCESS && std::rename(tmpname.c_str(), fname.c_str()) != 0)
+            status = ERR_FILE_ERROR;
+
+        if (status != SLM_SUCCESS)
+            std::remove(tmpname.c_str());
+    }
+
+    return status;
+}
+
+status_t DSLIM_UnmapIndexCache(Index *index)
+{
+    if (index->mmapaddr != NULL)
+    {
+        munmap(index->mmapaddr, index->mmapsize);
+
+        /* The chunks point into the mapping */
+        for (uint_t chno = 0; chno < index->nChunks && index->ionIndex != NULL; chno++)
+        {
+            index->ionIndex[chno].bA = NULL;
+            index->ionIndex[chno].iA = NULL;
+            index->ionIndex[chno].sA = NULL;
+        }
+
+        index->pepEntries = NULL;
+        index->pepIndex.seqs = NULL;
+
+        index->mmapaddr = NULL;
+        index->mmapsize = 0;
+    }
+
+    return SLM_SUCCESS;
+}
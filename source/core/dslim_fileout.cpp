@@ -132,7 +132,7 @@ status_t DFile_PrintScore(Index *index, uint_t specid, float_t pmass, hCell *psm
     tsvs[thno] << '\t' << std::to_string(psm->rtime);
     tsvs[thno] << '\t' << std::string_view(pep_string, peplen);
     tsvs[thno] << '\t' << std::to_string(psm->sharedions);
-    tsvs[thno] << '\t' << std::to_string(psm->totalions);
+    tsvs[thno] << '\t' << std::to_string((peplen - 1) * params.maxz * iSERIES);
     tsvs[thno] << '\t' << std::to_string(lclindex->pepEntries[pepid].Mass);
     tsvs[thno] << '\t' << std::to_string((pmass - lclindex->pepEntries[pepid].Mass));
     tsvs[thno] << '\t'; // TODO: print (mod_info) here
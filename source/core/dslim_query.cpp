@@ -18,6 +18,8 @@
  */
 
 #include <thread>
+#include <condition_variable>
+#include <numeric>
 #include <semaphore.h>
 #include <unistd.h>
 #include "dslim_fileout.h"
@@ -25,6 +27,7 @@
 #include "dslim.h"
 #include "lwqueue.h"
 #include "lwbuff.h"
+#include "wsdeque.h"
 #include "scheduler.h"
 #include "ms2prep.hpp"
 #include "hicops_instr.hpp"
@@ -48,8 +51,7 @@ hCell      *CandidatePSMS  = nullptr;
 Scheduler  *SchedHandle    = nullptr;
 expeRT     *ePtrs          = nullptr;
 
-/* Lock for query file vector and thread manager */
-lock_t qfilelock;
+/* Query files yet to be read */
 lwqueue<MSQuery *> *qfPtrs = nullptr;
 
 int_t spectrumID             = 0;
@@ -73,27 +75,42 @@ std::mutex gtimelock;
 
 #ifdef USE_MPI
 
-lock_t qfoutlock;
 lwqueue<ebuffer*> *qfout   = nullptr;
 std::vector<std::thread> fouts;
+
+/* Lock for the batch records of the CommHandle */
+lock_t commlock;
 VOID DSLIM_FOut_Thread_Entry();
-std::atomic<bool> exitSignal(false);
 
 #endif // USE_MPI
 
 /* A queue containing I/O thread state when preempted */
 lwqueue<MSQuery *> *ioQ = nullptr;
-lock_t ioQlock;
-std::atomic<bool> scheduler_init(false);
+
+/* Posted once the SchedHandle is set up */
+lock_t schedinit;
 
 //
 // -------------------------- Static functions ----------------------------------
 //
 
-static BOOL   DSLIM_BinarySearch(Index *, float_t, int_t&, int_t&);
-static int_t  DSLIM_BinFindMin(pepEntry *entries, float_t pmass1, int_t min, int_t max);
-static int_t  DSLIM_BinFindMax(pepEntry *entries, float_t pmass2, int_t min, int_t max);
+static BOOL   DSLIM_PrecursorWindow(Index *, float_t, int_t&, int_t&);
+static inline VOID DSLIM_ScoreHit(BYICount *, int_t, int_t, int_t, uint_t);
+static inline VOID DSLIM_ScatterHits(BYICount *, const BYHit *, uint_t);
+static inline VOID DSLIM_QueryChunk(spectype_t *, spectype_t *, uint_t, int_t, Index *, uint_t, uint_t, int_t, int_t, BYICount *, Results *);
+template <int_t DF, bool_t MATCHZ, bool_t BLOCKED>
+static VOID DSLIM_QueryKernel(spectype_t *, spectype_t *, uint_t, int_t, Index *, uint_t, uint_t, int_t, int_t, BYICount *, Results *);
+static VOID DSLIM_Rescore(spectype_t *, spectype_t *, uint_t, int_t, Index *, BYICount *, Results *, Results *);
+static status_t DSLIM_QueryResults(Queries<spectype_t> *, Index *, int_t, int, Results *, expeRT *, partRes *, ebuffer *);
+static status_t DSLIM_PrepareBatch(qbatch_t *, Queries<spectype_t> *, int_t);
+static status_t DSLIM_QueryUnits(qbatch_t *, Index *, uint_t, int_t, int_t);
+static status_t DSLIM_FinishBatch(qbatch_t *);
+static bool_t   DSLIM_SplitTask(wsdeque<WSQSIZE> *, ull_t &);
+static status_t DSLIM_SearchTask(qbatch_t *, ull_t, Index *, uint_t, bool_t &);
+static inline uint_t DSLIM_SkipLowerBound(const uint_t *, const uint_t *, uint_t, uint_t, uint_t);
 static inline status_t DSLIM_Deinit_IO();
+static inline status_t DSLIM_Dispatch_IO();
+static inline status_t DSLIM_Replenish_IO(Queries<spectype_t> *);
 
 //
 // ------------------------------------------------------------------------------
@@ -101,10 +118,12 @@ static inline status_t DSLIM_Deinit_IO();
 
 /* FUNCTION: DSLIM_WaitFor_IO
  *
- * DESCRIPTION:
+ * DESCRIPTION: Sleep until the I/O threads have
+ *              a batch ready and take it
  *
  * INPUT:
- * @none
+ * @workPtr  : Set to the ready batch
+ * @batchsize: Set to the number of spectra in it
  *
  * OUTPUT:
  * @status: status of execution
@@ -114,43 +133,67 @@ static inline status_t DSLIM_WaitFor_IO(Queries<spectype_t>* &, int_t &);
 
 static inline status_t DSLIM_WaitFor_IO(Queries<spectype_t> *&workPtr, int_t &batchsize)
 {
-    status_t status;
+    status_t status = SLM_SUCCESS;
 
     batchsize = 0;
 
-    /* Wait for a I/O request */
-    status = qPtrs->lockr_();
-
-    /* Check for either a buffer or stopSignal */
-    while (qPtrs->isEmptyReadyQ())
-    {
-        /* If both conditions fail,
-         * the I/O threads still working */
-        status = qPtrs->unlockr_();
+    /* Get the I/O ptr from the ready queue */
+    workPtr = qPtrs->waitWorkPtr();
 
-        // safety from a rare race condition
-        if (!SchedHandle->getNumActivThds())
-            SchedHandle->dispatchThread();
+    if (workPtr == nullptr)
+        status = ERR_INVLD_PTR;
+    else
+        batchsize = workPtr->numSpecs;
 
-        sleep(0.1);
+    return status;
+}
 
-        status = qPtrs->lockr_();
-    }
+/* FUNCTION: DSLIM_Dispatch_IO
+ *
+ * DESCRIPTION: Dispatch an I/O thread if all have retired
+ *              while there are empty buffers and spectra
+ *              left to read. Called after each action that
+ *              can create that state: a buffer returned, an
+ *              I/O thread retired or a Query parked
+ *
+ * INPUT: none
+ *
+ * OUTPUT:
+ * @status: status of execution
+ *
+ */
+static inline status_t DSLIM_Dispatch_IO()
+{
+    status_t status = SLM_SUCCESS;
 
-    if (status == SLM_SUCCESS)
-    {
-        /* Get the I/O ptr from the wait queue */
-        workPtr = qPtrs->getWorkPtr();
+    /* Order the caller's action before the checks so that
+     * the last of any two racing actions sees the other */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
-        if (workPtr == nullptr)
-            status = ERR_INVLD_PTR;
+    if (!SchedHandle->getNumActivThds() && !qPtrs->isEmptyWaitQ() &&
+        (!ioQ->isEmpty() || !qfPtrs->isEmpty()))
+        status = SchedHandle->dispatchIdle();
 
-        status = qPtrs->unlockr_();
+    return status;
+}
 
-        batchsize = workPtr->numSpecs;
-    }
+/* FUNCTION: DSLIM_Replenish_IO
+ *
+ * DESCRIPTION: Return a searched batch to the I/O threads
+ *
+ * INPUT:
+ * @workPtr: The searched batch
+ *
+ * OUTPUT:
+ * @status: status of execution
+ *
+ */
+static inline status_t DSLIM_Replenish_IO(Queries<spectype_t> *workPtr)
+{
+    /* Request next I/O chunk */
+    qPtrs->Replenish(workPtr);
 
-    return status;
+    return DSLIM_Dispatch_IO();
 }
 
 status_t DSLIM_MS2Initialize()
@@ -169,18 +212,14 @@ status_t DSLIM_MS2Initialize()
 
     MARK_START(ms2init);
 
-    /* The mutex for queryfile vector */
+    /* The queryfile queue */
     if (status == SLM_SUCCESS)
-    {
-        status = sem_init(&qfilelock, 0, 1);
-
         status = hcp::ms2::initialize(&qfPtrs, nBatches, dssize);
-    }
 
     /* Initialize the lw double buffer queues with
      * capacity, min and max thresholds */
     if (status == SLM_SUCCESS)
-        qPtrs = new lwbuff<Queries<spectype_t>>(20, 5, 15); // cap, th1, th2
+        qPtrs = new lwbuff<Queries<spectype_t>>(NIBUFFS, 5, 15); // cap, th1, th2
 
     /* Initialize the ePtrs */
     if (status == SLM_SUCCESS)
@@ -194,8 +233,10 @@ status_t DSLIM_MS2Initialize()
         {
             Queries<spectype_t> *nPtr = new Queries<spectype_t>;
 
-            /* Initialize the query buffer */
-            nPtr->init();
+            /* Initialize the query buffer. The .pbin batches
+             * are viewed in place so allocate on demand */
+            if (params.filetype == gParams::FileType_t::MS2)
+                nPtr->init();
 
             /* Add them to the buffer */
             qPtrs->Add(nPtr);
@@ -212,9 +253,6 @@ status_t DSLIM_MS2Initialize()
         /* Check for correct allocation */
         if (ioQ == nullptr)
             status = ERR_BAD_MEM_ALLOC;
-
-        /* Initialize the ioQlock */
-        status = sem_init(&ioQlock, 0, 1);
     }
 
     MARK_END(ms2init);
@@ -244,7 +282,6 @@ status_t DSLIM_Setup_Handles()
 #ifdef USE_MPI
     else if (params.nodes > 1)
     {
-        status = sem_init(&qfoutlock, 0, 1);
         qfout = new lwqueue<ebuffer*> (nBatches);
 
         // create two threads for fout
@@ -262,6 +299,8 @@ status_t DSLIM_Setup_Handles()
         /* Allocate a new DSLIM Comm handle */
         if (status == SLM_SUCCESS)
         {
+            sem_init(&commlock, 0, 1);
+
             CommHandle = new DSLIM_Comm(nBatches);
 
             if (CommHandle == nullptr)
@@ -283,13 +322,17 @@ status_t DSLIM_Setup_Handles()
     /* Create a new Scheduler handle */
     if (status == SLM_SUCCESS)
     {
+        /* The I/O threads dispatched by the Scheduler
+         * sleep on schedinit until the handle is set */
+        sem_init(&schedinit, 0, 0);
+
         SchedHandle = new Scheduler;
 
         /* Check for correct allocation */
         if (SchedHandle == nullptr)
             status = ERR_BAD_MEM_ALLOC;
         else
-            scheduler_init = true;
+            sem_post(&schedinit);
     }
 
     return status;
@@ -404,9 +447,7 @@ void GPU_DistributedSearch(Index *index)
         if (bid != (nBatches - 1))
         {
             /* Check the status of buffer queues */
-            qPtrs->lockr_();
             int_t dec = qPtrs->readyQStatus();
-            qPtrs->unlockr_();
 
             /* Run the Scheduler to manage thread between compute and I/O */
             SchedHandle->runManager(penalty, dec);
@@ -432,12 +473,8 @@ void GPU_DistributedSearch(Index *index)
         SpSpGEMMTime += ELAPSED_SECONDS(SpSpGEMM);
         std::cout << "gSearch Time: " << SpSpGEMMTime << std::endl;
 
-        status = qPtrs->lockw_();
-
         /* Request next I/O chunk */
-        qPtrs->Replenish(gWorkPtr);
-
-        status = qPtrs->unlockw_();
+        status = DSLIM_Replenish_IO(gWorkPtr);
     }
 
     MARK_END(gpu_search_time);
@@ -513,104 +550,303 @@ status_t DistributedSearch(Index *index)
 
 #endif // USE_TIMEMORY
 
-    // initialize to nullptr
-    Queries<spectype_t> *workPtr = nullptr;
-    int myspecId = 0;
+    /* Batches in flight and the task deques of the workers */
+    qbatch_t *batches = new qbatch_t[NIBUFFS];
+    wsdeque<WSQSIZE> *deques = new wsdeque<WSQSIZE>[params.threads];
 
-    /* The main search loop starts here */
-    for (int_t bid = 0;;)
-    {
-        // lock global batch lock
-        gBatchlock.lock();
+    /* Should at least be 1 and min 75% */
+    const int_t minthreads = MAX(1, (params.threads * 3)/4);
 
-        bid = gBatchID;
+    /* Number of searching workers. The others park
+     * to leave their cores to the I/O threads */
+    std::atomic<int_t> active(MAX((int_t) params.threads - (int_t) SchedHandle->getNumActivThds(), minthreads));
 
-        // if all batches completed, then break
-        if (bid >= nBatches)
-        {
-            // make sure to unlock before breaking
-            gBatchlock.unlock();
-            break;
-        }
+    /* Batches acquired but not searched yet */
+    std::atomic<int_t> inflight(0);
+    std::atomic<bool_t> allacq(false);
 
-        // increase the gBatchID
-        gBatchID++;
+    /* Bumped on each batch acquired or completed, and on each
+     * split that leaves work for parked idle workers to steal */
+    std::mutex parklock;
+    std::condition_variable parkcv;
+    std::atomic<ull_t> wsgen(0);
+    std::atomic<int_t> nidle(0);
 
-#if defined(USE_TIMEMORY)
-        static wall_tuple_t sched_penalty("DAG_Penalty", false);
-        sched_penalty.start();
-#endif
+    auto wake = [&]()
+    {
+        std::lock_guard<std::mutex> lk(parklock);
+        wsgen++;
+        parkcv.notify_all();
+    };
 
-        /* Start computing penalty */
-        MARK_START(penal);
+    auto stealable = [&]()
+    {
+        for (uint_t w = 0; w < params.threads; w++)
+            if (!deques[w].isEmpty())
+                return true;
 
-        status = DSLIM_WaitFor_IO(workPtr, batchsize);
+        return false;
+    };
 
-        // update the local spec id and update the global one
-        myspecId = spectrumID;
-        spectrumID += workPtr->numSpecs;
+    /* Park until the next event after gen. Idle workers also
+     * return if work shows up in a deque, which the splitters
+     * only signal after seeing nidle (Dekker with the fences) */
+    auto park = [&](ull_t gen, bool_t idle)
+    {
+        std::unique_lock<std::mutex> lk(parklock);
 
-        // unlock as soon as batch extracted
-        gBatchlock.unlock();
+        if (idle)
+        {
+            nidle++;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
 
-#if defined(USE_TIMEMORY)
-        sched_penalty.stop();
-#endif
-        /* Compute the penalty */
-        MARK_END(penal);
+        parkcv.wait(lk, [&]{ return wsgen != gen || (idle && stealable()); });
 
-        auto penalty = ELAPSED_SECONDS(penal);
-        ptime += penalty;
+        if (idle)
+            nidle--;
+    };
 
-#ifndef DIAGNOSE
-        if (params.myid == 0)
-            std::cout << "PENALTY:   \t" << penalty << "s" << std::endl;
-#endif /* DIAGNOSE */
+    /* Hand a searched batch over and return its buffer to the I/O */
+    auto complete = [&](qbatch_t *batch)
+    {
+        auto stime = std::chrono::duration<double>(std::chrono::system_clock::now() - batch->start).count();
+        int_t batchNum = batch->ss->batchNum;
 
-        // if last batch then no need for the scheduler
-        if (bid != (nBatches - 1))
-        {
-            /* Check the status of buffer queues */
-            qPtrs->lockr_();
-            int_t dec = qPtrs->readyQStatus();
-            qPtrs->unlockr_();
+        status_t cstatus = DSLIM_FinishBatch(batch);
 
-            /* Run the Scheduler to manage thread between compute and I/O */
-            SchedHandle->runManager(penalty, dec);
-        }
+        if (cstatus == SLM_SUCCESS)
+            cstatus = DSLIM_Replenish_IO(batch->ss);
 
 #ifndef DIAGNOSE
         if (params.myid == 0)
         {
-            std::cout << "\nBatch:\t\t" << workPtr->batchNum << std::endl;
-            std::cout << "Spectra:\t" << workPtr->numSpecs << std::endl;
+            std::ostringstream report;
+            report << "\nBatch:\t\t" << batchNum << "\nSearch Time:\t" << stime << "s" << std::endl;
+            std::cout << report.str();
         }
+#else
+        UNUSED_PARAM(stime);
+        UNUSED_PARAM(batchNum);
 #endif /* DIAGNOSE */
 
-        MARK_START(search_time);
+        batch->busy = false;
+        inflight--;
 
-        if (status == SLM_SUCCESS)
-            /* Query the chunk */
-            status = DSLIM_QuerySpectrum(workPtr, index, (maxlen - minlen + 1), myspecId);
+        wake();
 
-        status = qPtrs->lockw_();
+        return cstatus;
+    };
 
-        /* Request next I/O chunk */
-        qPtrs->Replenish(workPtr);
+    MARK_START(search_time);
+
+    /* The main search loop starts here. One persistent team searches
+     * all batches: each worker runs the tasks in its own deque, steals
+     * from the others and, once idle, acquires the next ready batch
+     * while the others finish the tail of the current ones */
+#ifdef USE_OMP
+#pragma omp parallel num_threads(params.threads)
+#endif /* USE_OMP */
+    {
+        const int_t thno = omp_get_thread_num();
+        const int_t nworkers = omp_get_num_threads();
+        status_t lstatus = SLM_SUCCESS;
+        status_t tstatus = SLM_SUCCESS;
+        ull_t task = 0;
+        int_t spins = 0;
+
+        for (;;)
+        {
+            ull_t gen = wsgen;
+            bool_t found = deques[thno].pop(task);
+
+            for (int_t v = 1; !found && thno < active && v < nworkers; v++)
+                found = deques[(thno + v) % nworkers].steal(task);
+
+            if (found)
+            {
+                bool_t done = false;
+
+                spins = 0;
+
+                /* Wake the idle workers to steal the split halves */
+                if (DSLIM_SplitTask(deques + thno, task))
+                {
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                    if (nidle)
+                        wake();
+                }
+
+                tstatus = DSLIM_SearchTask(batches, task, index, (maxlen - minlen + 1), done);
+
+                if (tstatus == SLM_SUCCESS && done)
+                    tstatus = complete(batches + WSSLOT(task));
+
+                if (tstatus != SLM_SUCCESS)
+                    lstatus = tstatus;
+
+                continue;
+            }
+
+            /* All batches searched */
+            if (allacq && !inflight)
+                break;
+
+            /* Park until the next batch event */
+            if (thno >= active)
+            {
+                park(gen, false);
+                continue;
+            }
+
+            /* Steal the tail of the last batches for a
+             * few passes, then park until a split or the
+             * completion of a batch */
+            if (allacq)
+            {
+                if (++spins < WSSPINS)
+                    std::this_thread::yield();
+                else
+                {
+                    spins = 0;
+                    park(gen, true);
+                }
+
+                continue;
+            }
+
+            /* Acquire the next batch. The idle workers sleep
+             * here while the holder waits for the I/O threads */
+            gBatchlock.lock();
+
+            int_t bid = gBatchID;
+            int_t slot = 0;
+
+            while (slot < NIBUFFS && batches[slot].busy)
+                slot++;
+
+            /* Retry stealing if a batch came in meanwhile, or
+             * park until a batch completes and frees its slot */
+            if (wsgen != gen || bid >= nBatches || slot == NIBUFFS)
+            {
+                if (bid >= nBatches)
+                    allacq = true;
+
+                gBatchlock.unlock();
+
+                if (allacq)
+                    wake();
+                else if (wsgen == gen)
+                    park(gen, true);
 
-        status = qPtrs->unlockw_();
+                continue;
+            }
+
+            // increase the gBatchID
+            gBatchID++;
+
+#if defined(USE_TIMEMORY)
+            static wall_tuple_t sched_penalty("DAG_Penalty", false);
+            sched_penalty.start();
+#endif
+
+            /* Start computing penalty */
+            MARK_START(penal);
+
+            Queries<spectype_t> *workPtr = nullptr;
+
+            tstatus = DSLIM_WaitFor_IO(workPtr, batchsize);
+
+#if defined(USE_TIMEMORY)
+            sched_penalty.stop();
+#endif
+            /* Compute the penalty */
+            MARK_END(penal);
+
+            if (tstatus != SLM_SUCCESS)
+            {
+                lstatus = tstatus;
+                allacq = true;
+
+                gBatchlock.unlock();
+                wake();
+
+                continue;
+            }
 
-        MARK_END(search_time);
+            // update the local spec id and update the global one
+            int_t myspecId = spectrumID;
+            spectrumID += batchsize;
 
-        /* Compute Duration */
-        qtime +=  ELAPSED_SECONDS(search_time);
+            auto penalty = ELAPSED_SECONDS(penal);
+            ptime += penalty;
+
+            // if last batch then no need for the scheduler
+            if (bid != (nBatches - 1))
+            {
+                /* Check the status of buffer queues */
+                int_t dec = qPtrs->readyQStatus();
+
+                /* Run the Scheduler to manage thread between compute and I/O */
+                SchedHandle->runManager(penalty, dec);
+            }
+
+            /* Resize the team around the I/O threads */
+            active = MAX((int_t) params.threads - (int_t) SchedHandle->getNumActivThds(), minthreads);
+
+            qbatch_t *batch = batches + slot;
+
+            tstatus = DSLIM_PrepareBatch(batch, workPtr, myspecId);
+
+            batch->start = std::chrono::system_clock::now();
+            batch->busy = true;
+            inflight++;
 
 #ifndef DIAGNOSE
-        if (params.myid == 0)
-            std::cout << "\nSearch Time:\t" << ELAPSED_SECONDS(search_time) << "s" << std::endl;
+            if (params.myid == 0)
+            {
+                std::ostringstream report;
+                report << "PENALTY:   \t" << penalty << "s" << std::endl
+                       << "\nBatch:\t\t" << workPtr->batchNum << std::endl
+                       << "Spectra:\t" << workPtr->numSpecs << std::endl
+                       << "Threads:\t" << active * params.nodes << std::endl;
+                std::cout << report.str();
+            }
 #endif /* DIAGNOSE */
+
+            if (tstatus == SLM_SUCCESS && batch->nunits > 0)
+                deques[thno].push(WSTASK(slot, 0, batch->nunits));
+            else
+            {
+                if (tstatus != SLM_SUCCESS)
+                    lstatus = tstatus;
+
+                tstatus = complete(batch);
+            }
+
+            /* Unlock after the wake so the next holder retries stealing */
+            wake();
+            gBatchlock.unlock();
+        }
+
+#ifdef USE_OMP
+#pragma omp critical
+#endif /* USE_OMP */
+        {
+            if (lstatus != SLM_SUCCESS)
+                status = lstatus;
+        }
     }
 
+    MARK_END(search_time);
+
+    /* Search overlaps the penalty across batches */
+    qtime = ELAPSED_SECONDS(search_time);
+
+    delete[] batches;
+    delete[] deques;
+
 #if defined (USE_TIMEMORY)
         search_inst.stop();
 #   if defined (_UNIX)
@@ -646,6 +882,7 @@ status_t DistributedSearch(Index *index)
     if (params.myid == 0)
     {
         std::cout << "\nCumulative Penalty:     " << ptime << "s" << std::endl;
+        std::cout << "\nCumulative I/O Wait:    " << qPtrs->waitTime() << "s" << std::endl;
         std::cout << "\nCumulative Search Time: " << qtime << "s" << std::endl << std::endl;
     }
 
@@ -660,12 +897,16 @@ status_t DSLIM_Destroy_Handles(Index *index)
 {
     status_t status = SLM_SUCCESS;
 
+#ifndef USE_MPI
+    UNUSED_PARAM(index);
+#endif /* USE_MPI */
+
 #ifdef USE_MPI
     /* Deinitialize the Communication module */
     if (params.nodes > 1)
     {
         // signal fout threads to exit
-        exitSignal = true;
+        qfout->close();
 
 #if defined (USE_TIMEMORY)
         wall_tuple_t comm_penalty("comm_ovhd");
@@ -686,7 +927,10 @@ status_t DSLIM_Destroy_Handles(Index *index)
 #endif // USE_TIMEMORY
 
         if (params.myid == 0)
+        {
             std::cout << "Total Comm Overhead: " << ELAPSED_SECONDS(comm_ovd) << 's'<< std::endl;
+            std::cout << "FOut Wait Time: " << qfout->waitTime() << 's'<< std::endl;
+        }
 
         //
         // Synchronization
@@ -746,505 +990,1080 @@ status_t DSLIM_Destroy_Handles(Index *index)
 
 // --------------------------------------------------------------------------------------------- //
 
-status_t DSLIM_QuerySpectrum(Queries<spectype_t> *ss, Index *index, uint_t idxchunk, int currSpecID)
+/*
+ * FUNCTION: DSLIM_ScoreHit
+ *
+ * DESCRIPTION: Add a fragment-ion hit to the scorecard
+ *
+ * INPUT:
+ * @sc  : Scorecard of the thread
+ * @ppid: Chunk-local peptide ID
+ * @isB : 1 if a b-ion hit
+ * @isY : 1 if a y-ion hit
+ * @intn: Intensity of the matched peak
+ *
+ * OUTPUT: none
+ */
+static inline VOID DSLIM_ScoreHit(BYICount *sc, int_t ppid, int_t isB, int_t isY, uint_t intn)
 {
-    status_t status = SLM_SUCCESS;
-    int_t threads = (int_t) params.threads - (int_t) SchedHandle->getNumActivThds();
-    uint_t maxz = params.maxz;
-    uint_t dF = params.dF;
-    uint_t scale = params.scale;
-    double_t maxmass = params.max_mass;
-    ebuffer *liBuff = nullptr;
-    partRes *txArray = nullptr;
-
-    // static instance of the log(factorial(x)) array
-    static auto lgfact = hcp::utils::lgfact<hcp::utils::maxshp>();
+    /* Get the map element */
+    scEntry &elmnt = sc->byc[ppid];
 
-    if (params.nodes > 1)
+    /* Record the first hit of this candidate. Once the touched
+     * list overflows the window is scanned and cleared densely */
+    if (SC_Empty(elmnt) && isB + isY != 0)
     {
-        liBuff = new ebuffer;
+        if (sc->ntouched < sc->mtouched)
+            sc->touched[sc->ntouched] = ppid;
 
-        txArray = liBuff->packs;
-        liBuff->isDone = false;
-        liBuff->batchNum = ss->batchNum;
-    }
-    else
-    {
-        UNUSED_PARAM(liBuff);
+        sc->ntouched++;
     }
 
-#if !defined(USE_OMP)
-    UNUSED_PARAM(threads);
-#endif /* USE_OMP */
-
-    /* Sanity checks */
-    if (Score == nullptr || (txArray == nullptr && params.nodes > 1))
-        status = ERR_INVLD_MEMORY;
+    /* Update */
+    SC_Add(elmnt, isB, isY, intn);
+}
 
-    if (status == SLM_SUCCESS)
+/*
+ * FUNCTION: DSLIM_ScatterHits
+ *
+ * DESCRIPTION: Apply the buffered hits of a scorecard block
+ *
+ * INPUT:
+ * @sc   : Scorecard of the thread
+ * @hits : Buffered hits
+ * @nhits: Number of hits
+ *
+ * OUTPUT: none
+ */
+static inline VOID DSLIM_ScatterHits(BYICount *sc, const BYHit *hits, uint_t nhits)
+{
+    for (uint_t h = 0; h < nhits; h++)
     {
-        /* Should at least be 1 and min 75% */
-        int_t minthreads = MAX(1, (params.threads * 3)/4);
+        int_t isY = hits[h].key & 0x1;
 
-        threads = MAX(threads, minthreads);
+        DSLIM_ScoreHit(sc, hits[h].key >> 1, 1 - isY, isY, hits[h].intn);
+    }
+}
 
-#ifndef DIAGNOSE
-        /* Print how many threads are we using here */
-        if (params.myid == 0)
-        {
-            /* Print the number of query threads */
-            std::cout << "Threads:\t" << threads * params.nodes << std::endl;
-        }
-#endif /* DIAGNOSE */
+/*
+ * FUNCTION: DSLIM_QueryChunk
+ *
+ * DESCRIPTION: Query a spectrum against a chunk of an index
+ *              and insert the candidate PSMs into the results
+ *              using the query kernel specialized for the run
+ *
+ * INPUT:
+ * @QAPtr   : m/z of the query peaks
+ * @iPtr    : Intensities of the query peaks
+ * @qspeclen: Number of query peaks
+ * @pchg    : Precursor charge of the query
+ * @index   : The SLM Indices
+ * @ixx     : Index (peptide length) number
+ * @chno    : Chunk number
+ * @minlimit: Precursor window start (pepEntries)
+ * @maxlimit: Precursor window end (pepEntries)
+ * @sc      : Scorecard of the thread
+ * @resPtr  : Results of the query
+ *
+ * OUTPUT: none
+ */
+static inline VOID DSLIM_QueryChunk(spectype_t *QAPtr, spectype_t *iPtr, uint_t qspeclen, int_t pchg,
+                                    Index *index, uint_t ixx, uint_t chno, int_t minlimit, int_t maxlimit,
+                                    BYICount *sc, Results *resPtr)
+{
+    using kernel_t = VOID (*)(spectype_t *, spectype_t *, uint_t, int_t, Index *, uint_t, uint_t,
+                              int_t, int_t, BYICount *, Results *);
 
-        /* Process all the queries in the chunk.
-         * Setting chunk size to 4 to avoid false sharing
-         */
-#ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule(dynamic, 4)
-#endif /* USE_OMP */
-        for (int_t queries = 0; queries < ss->numSpecs; queries++)
-        {
-            /* Pointer to each query spectrum */
-            auto *QAPtr = ss->moz + ss->idx[queries];
-            float_t pmass = ss->precurse[queries];
-            auto    pchg  = ss->charges[queries];
-            auto    rtime = ss->rtimes[queries];
-            auto    *iPtr = ss->intensity + ss->idx[queries];
-            auto qspeclen = ss->idx[queries + 1] - ss->idx[queries];
-            auto thno = omp_get_thread_num();
+    /* Kernels over [charge matching][blocked scatter] for each dF */
+#define QKERNELS(df)                       {{ DSLIM_QueryKernel<df, false, false>, DSLIM_QueryKernel<df, false, true> }, \
+                                            { DSLIM_QueryKernel<df, true, false>,  DSLIM_QueryKernel<df, true, true> }}
 
-            BYC *bycPtr     = Score[thno].byc;
-            Results *resPtr = &Score[thno].res;
-            expeRT  *expPtr = ePtrs + thno;
-            ebuffer *inBuff = inBuff + thno;
+    static const kernel_t kernels[QKERNELDF + 2][2][2] = { QKERNELS(0), QKERNELS(1), QKERNELS(2), QKERNELS(3),
+                                                           QKERNELS(4), QKERNELS(-1) };
+#undef QKERNELS
 
-#if defined (PROGRESS)
-            if (thno == 0 && params.myid == 0)
-                std::cout << "\rDONE:\t\t" << (queries * 100) /ss->numSpecs << "%";
-#endif // PROGRESS
+    /* Pick the dF specialization once (generic if dF > QKERNELDF) */
+    static const auto &kernel = kernels[std::min(params.dF, (uint_t)QKERNELDF + 1)];
 
-            for (uint_t ixx = 0; ixx < idxchunk; ixx++)
-            {
-                uint_t speclen = (index[ixx].pepIndex.peplen - 1) * maxz * iSERIES;
-                uint_t halfspeclen = speclen / 2;
-#ifdef MATCH_CHARGE
-                uint_t peplen_1 = index[ixx].pepIndex.peplen - 1;
-#endif // MATCH_CHARGE
+    spmat_t *chunk = index[ixx].ionIndex + chno;
 
-                for (uint_t chno = 0; chno < index[ixx].nChunks; chno++)
-                {
-                    /* Query each chunk in parallel */
-                    uint_t *bAPtr = index[ixx].ionIndex[chno].bA;
-                    uint_t *iAPtr = index[ixx].ionIndex[chno].iA;
+    /* Window in the chunk-local peptide IDs */
+    const int_t pepoffset = chunk->pepoffset;
+    const int_t lclmin = std::max(minlimit, pepoffset) - pepoffset;
+    const int_t lclmax = std::min(maxlimit, pepoffset + (int_t)chunk->npeps - 1) - pepoffset;
 
-                    int_t minlimit = 0;
-                    int_t maxlimit = 0;
+    /* Skip the chunks outside the window */
+    if (lclmax < lclmin)
+        return;
 
-                    BOOL val = DSLIM_BinarySearch(index + ixx, ss->precurse[queries], minlimit, maxlimit);
+    /* Ion charges never exceed maxz so the charge check
+     * can only reject the ions of queries with pchg < maxz */
+    const bool_t matchz = params.matchz && (uint_t)pchg < params.maxz;
 
-                    // FIXME: remove me // std::cout << " qno = " << queries << " ixx = " << ixx << " chno = " << chno << " minlimit = " << minlimit << " maxlimit = " << maxlimit << std::endl;
+    /* Scatter the hits into wide windows block by block */
+    const bool_t blocked = (uint_t)(lclmax - lclmin + 1) >= SCATTERWIN;
 
-                    /* Spectrum violates limits */
-                    if (val == false || (maxlimit < minlimit))
-                        continue;
+    kernel[matchz][blocked](QAPtr, iPtr, qspeclen, pchg, index, ixx, chno, lclmin, lclmax, sc, resPtr);
+}
 
-                    /* Query all fragments in each spectrum */
-                    for (uint_t k = 0; k < qspeclen; k++)
-                    {
-                        /* Do this to save mem boundedness */
-                        auto qion = QAPtr[k];
-                        uint_t intn = iPtr[k];
+/*
+ * FUNCTION: DSLIM_QueryKernel
+ *
+ * DESCRIPTION: Query kernel specialized over the fragment mass
+ *              tolerance (DF < 0 reads params.dF at runtime),
+ *              the charge matching and the blocked scatter
+ *
+ * INPUT:
+ * @QAPtr   : m/z of the query peaks
+ * @iPtr    : Intensities of the query peaks
+ * @qspeclen: Number of query peaks
+ * @pchg    : Precursor charge of the query
+ * @index   : The SLM Indices
+ * @ixx     : Index (peptide length) number
+ * @chno    : Chunk number
+ * @lclmin  : Precursor window start (chunk-local)
+ * @lclmax  : Precursor window end (chunk-local)
+ * @sc      : Scorecard of the thread
+ * @resPtr  : Results of the query
+ *
+ * OUTPUT: none
+ */
+template <int_t DF, bool_t MATCHZ, bool_t BLOCKED>
+CPU_KERNEL
+static VOID DSLIM_QueryKernel(spectype_t *QAPtr, spectype_t *iPtr, uint_t qspeclen, int_t pchg,
+                              Index *index, uint_t ixx, uint_t chno, int_t lclmin, int_t lclmax,
+                              BYICount *sc, Results *resPtr)
+{
+    const uint_t dF = (DF < 0) ? params.dF : DF;
+    const uint_t scale = params.scale;
+    const double_t maxmass = params.max_mass;
+    const ushort_t minshp = params.min_shp;
 
-                        /* Check for any zeros
-                         * Zero = Trivial query */
-                        if (qion > dF && qion < ((maxmass * scale) - 1 - dF))
-                        {
-                            for (auto bin = qion - dF; bin < qion + 1 + dF; bin++)
-                            {
-                                /* Locate iAPtr start and end */
-                                uint_t start = bAPtr[bin];
-                                uint_t end = bAPtr[bin + 1];
+    // static instance of the log(factorial(x)) array
+    static auto lgfact = hcp::utils::lgfact<hcp::utils::maxshp>();
 
-                                /* If no ions in the bin */
-                                if (end - start < 1)
-                                    continue;
+    spmat_t *chunk  = index[ixx].ionIndex + chno;
+    uint_t *bAPtr = chunk->bA;
+    uint_t *iAPtr = chunk->iA;
+    uint_t *sAPtr = chunk->sA;
 
-                                auto ptr = std::lower_bound(iAPtr + start, iAPtr + end, minlimit * speclen);
-                                int_t stt = start + std::distance(iAPtr + start, ptr);
+    scEntry *bycPtr = sc->byc;
+    uint_t *touched = sc->touched;
+    uint_t &ntouched = sc->ntouched;
 
-                                ptr = std::upper_bound(iAPtr + stt, iAPtr + end, (((maxlimit + 1) * speclen) - 1));
-                                int_t ends = stt + std::distance(iAPtr + stt, ptr) - 1;
+    const int_t pepoffset = chunk->pepoffset;
 
-                                /* Loop through located iAions */
-                                for (auto ion = stt; ion <= ends; ion++)
-                                {
-                                    uint_t raw = iAPtr[ion];
+    BYHit *hits = sc->hits;
+    uint_t *nhits = sc->nhits;
 
-                                    /* Calculate parent peptide ID */
-                                    int_t ppid = (raw / speclen);
+    /* Scatter the blocked windows SCATTERWIN candidates at a time
+     * so that the hits only span the blocks of the hit buffers */
+    const int_t wstep = (BLOCKED) ? (int_t) SCATTERWIN : lclmax - lclmin + 1;
 
-                                    /* Calculate the residue */
-                                    int_t residue = (raw % speclen);
+    for (int_t wmin = lclmin; wmin <= lclmax; wmin += wstep)
+    {
+        const int_t wmax = std::min(wmin + wstep - 1, lclmax);
 
-                                    /* Either 0 or 1 */
-                                    int_t isY = residue / halfspeclen;
-                                    int_t isB = 1 - isY;
+        /* Window of encoded iA values to match */
+        const uint_t minion = ENCODEION(wmin, 0, 0);
+        const uint_t maxion = ENCODEION(wmax + 1, 0, 0) - 1;
 
-#ifdef MATCH_CHARGE
+        /* Query all fragments in each spectrum */
+        for (uint_t k = 0; k < qspeclen; k++)
+        {
+            /* Do this to save mem boundedness */
+            uint_t qion = QAPtr[k];
+            uint_t intn = iPtr[k];
 
-                                    // FIXME: Is this ichg computation and usage correct?
-                                    int_t ichg = (residue / peplen_1) % maxz;
-                                    ichg += 1;
+            /* Check for any zeros
+             * Zero = Trivial query */
+            if (qion > dF && qion < ((maxmass * scale) - 1 - dF))
+            {
+                for (auto bin = qion - dF; bin < qion + 1 + dF; bin++)
+                {
+                    /* Locate iAPtr start and end */
+                    uint_t start = bAPtr[bin];
+                    uint_t end = bAPtr[bin + 1];
 
-                                    // Check if the matched ion's charge is less than or equal to the precursor charge
-                                    isY *= (ichg <= pchg);
-                                    isB *= (ichg <= pchg);
+                    /* If no ions in the bin */
+                    if (end - start < 1)
+                        continue;
 
-#endif // MATCH_CHARGE
-                                    /* Get the map element */
-                                    BYC *elmnt = bycPtr + ppid;
+                    /* Locate the window start via the skip directory */
+                    uint_t stt = DSLIM_SkipLowerBound(iAPtr, sAPtr, start, end, minion);
 
-                                    /* Update */
-                                    elmnt->bc += isB;
-                                    elmnt->ibc += intn * isB;
+                    /* Loop through located iAions */
+                    for (uint_t ion = stt; ion < end && iAPtr[ion] <= maxion; ion++)
+                    {
+                        uint_t raw = iAPtr[ion];
 
-                                    elmnt->yc += isY;
-                                    elmnt->iyc += intn * isY;
-                                }
-                            }
-                        }
-                    }
+                        /* Calculate parent peptide ID */
+                        int_t ppid = IONPEPID(raw);
 
-                    /* Compute the chunksize to look further into */
-                    int_t csize = maxlimit - minlimit + 1;
+                        /* Either 0 or 1 */
+                        int_t isY = IONISY(raw);
+                        int_t isB = 1 - isY;
 
-                    /* Look for candidate PSMs */
-                    for (int_t it = minlimit; it <= maxlimit; it++)
-                    {
-                        ushort_t bcc = bycPtr[it].bc;
-                        ushort_t ycc = bycPtr[it].yc;
-                        ushort_t shpk = bcc + ycc;
+                        if (MATCHZ)
+                        {
+                            /* Charge of the matched ion */
+                            int_t ichg = IONCHG(raw);
+
+                            // Check if the matched ion's charge is less than or equal to the precursor charge
+                            isY *= (ichg <= pchg);
+                            isB *= (ichg <= pchg);
+                        }
 
-                        /* Filter by the min shared peaks */
-                        if (shpk >= params.min_shp)
+                        if (BLOCKED)
                         {
-                            /* Create a heap cell */
-                            hCell cell;
+                            if (isB + isY == 0)
+                                continue;
 
-                            // get the precomputed log(factorial(x))
-                            double_t h1 = lgfact[bcc] + lgfact[ycc];
+                            /* Buffer the hit in its scorecard block */
+                            uint_t blk = (ppid - wmin) >> SCBLOCKSHIFT;
+                            BYHit *buff = hits + (blk * SCHITS);
 
-                            /* Fill in the information */
-                            cell.hyperscore = h1 + log10(1 + bycPtr[it].ibc) + log10(1 + bycPtr[it].iyc) - 4;
+                            buff[nhits[blk]].key = (ppid << 1) | isY;
+                            buff[nhits[blk]].intn = intn;
 
-                            /* hyperscore < 0 means either b- or y- ions were not matched */
-                            if (cell.hyperscore > 0)
+                            /* Apply the full buffer */
+                            if (++nhits[blk] == SCHITS)
                             {
-                                if (cell.hyperscore >= MAX_HYPERSCORE)
-                                    cell.hyperscore = MAX_HYPERSCORE - 1;
-
-                                cell.idxoffset = ixx;
-                                cell.psid = it;
-                                cell.sharedions = shpk;
-                                cell.totalions = speclen;
-                                cell.pmass = pmass;
-                                cell.pchg = pchg;
-                                cell.rtime = rtime;
-                                cell.fileIndex = ss->fileNum;
-
-                                /* Insert the cell in the heap dst */
-                                resPtr->topK.insert(cell);
-
-                                /* Increase the N */
-                                resPtr->cpsms += 1;
-
-                                /* Update the histogram */
-                                resPtr->survival[(int_t) (cell.hyperscore * 10 + 0.5)] += 1;
+                                DSLIM_ScatterHits(sc, buff, SCHITS);
+                                nhits[blk] = 0;
                             }
                         }
+                        else
+                            DSLIM_ScoreHit(sc, ppid, isB, isY, intn);
                     }
-
-                    /* Clear the scorecard */
-                    std::memset(bycPtr + minlimit, 0x0, sizeof(BYC) * csize);
                 }
             }
+        }
 
-#ifdef USE_MPI
-            /* Distributed memory mode - Model partial Gumbel
-             * and transmit parameters to rx machine */
-            if (params.nodes > 1)
+        /* Apply the remaining hits a block at a time */
+        if (BLOCKED)
+        {
+            for (uint_t blk = 0; blk < SCBLOCKS(wmax - wmin + 1); blk++)
             {
-                /* Set the params.min_cpsm in dist mem mode to 1 */
-                if (resPtr->cpsms >= 1)
-                {
-                    /* Extract the top PSM */
-                    hCell& psm = resPtr->topK.getMax();
+                DSLIM_ScatterHits(sc, hits + (blk * SCHITS), nhits[blk]);
+                nhits[blk] = 0;
+            }
+        }
+    }
 
-                    /* Put it in the list */
-                    CandidatePSMS[currSpecID + queries] = psm;
+    /* Compute the chunksize to look further into */
+    int_t csize = lclmax - lclmin + 1;
 
-                    resPtr->maxhypscore = (psm.hyperscore * 10 + 0.5);
+    /* Walk only the touched candidates if they are
+     * sparse in the window. Sort them to visit the
+     * candidates in the same order as the dense scan */
+    const bool_t sparse = ((ull_t)ntouched * SPARSESC) < (ull_t)csize;
 
-                    status = expPtr->StoreIResults(resPtr, queries, liBuff);
+    if (sparse)
+        std::sort(touched, touched + ntouched);
 
-                    /* Fill in the Tx array cells */
-                    txArray[queries].min  = resPtr->minhypscore;
-                    txArray[queries].max2 = resPtr->nexthypscore;
-                    txArray[queries].max  = psm.hyperscore;
-                    txArray[queries].N    = resPtr->cpsms;
-                    txArray[queries].qID  = currSpecID + queries;
-                }
-                else
-                {
-                    /* Extract the top result
-                     * and put it in the list */
-                    CandidatePSMS[currSpecID + queries] = 0;
-
-                    /* Get the handle to the txArr
-                     * Fill it up and move on */
-                    txArray[queries] = 0;
-                    txArray[queries].qID  = currSpecID + queries;
-                }
-            }
+    const int_t ncands = (sparse) ? (int_t)ntouched : csize;
 
-            /* Shared memory mode - Do complete
-             * modeling and print results */
-            else
-#endif /* USE_MPI */
-            {
-                /* Check for minimum number of PSMs */
-                if (resPtr->cpsms >= params.min_cpsm)
-                {
-                    /* Extract the top PSM */
-                    hCell&& psm = resPtr->topK.getMax();
+    /* Tile of the candidates that share enough peaks */
+    int_t tid[HSTILE];
+    ushort_t tshp[HSTILE];
+    double_t thyp[HSTILE];
+    double_t tib[HSTILE];
+    double_t tiy[HSTILE];
 
-                    resPtr->maxhypscore = (psm.hyperscore * 10 + 0.5);
+    /* Look for candidate PSMs a tile at a time */
+    for (int_t cc0 = 0; cc0 < ncands; cc0 += HSTILE)
+    {
+        const int_t cend = std::min(cc0 + HSTILE, ncands);
+        int_t nt = 0;
 
-                    /* Compute expect score if there
-                     * are any candidate PSMs */
-#ifdef TAILFIT
-                    status = expPtr->ModelTailFit(resPtr);
+        /* Gather the candidates filtered by the min shared peaks */
+        for (int_t cc = cc0; cc < cend; cc++)
+        {
+            int_t it = (sparse) ? (int_t)touched[cc] : lclmin + cc;
 
-                    /* Linear Regression Parameters */
-                    double_t w = resPtr->mu;
-                    double_t b = resPtr->beta;
+            ushort_t bcc = SC_BCount(bycPtr[it]);
+            ushort_t ycc = SC_YCount(bycPtr[it]);
+            ushort_t shpk = bcc + ycc;
 
-                    w /= 1e6;
-                    b /= 1e6;
+            if (shpk >= minshp)
+            {
+                tid[nt] = it;
+                tshp[nt] = shpk;
+
+                // get the precomputed log(factorial(x))
+                thyp[nt] = lgfact[bcc] + lgfact[ycc];
+                tib[nt] = SC_BIntn(bycPtr[it]);
+                tiy[nt] = SC_YIntn(bycPtr[it]);
+                nt++;
+            }
+        }
 
-                    /* Estimate the log (s(x)); x = log(hyperscore) */
-                    double_t lgs_x = (w * resPtr->maxhypscore) + b;
+        /* Compute the hyperscores of the tile */
+#ifdef USE_OMP
+#pragma omp simd
+#endif /* USE_OMP */
+        for (int_t t = 0; t < nt; t++)
+            thyp[t] = thyp[t] + hcp::utils::log10p1(tib[t]) + hcp::utils::log10p1(tiy[t]) - 4;
 
-                    /* Compute the s(x) */
-                    double_t e_x = pow(10, lgs_x);
+        /* Emit the candidates in the scan order */
+        for (int_t t = 0; t < nt; t++)
+        {
+            /* Create a heap cell */
+            hCell cell;
 
-                    /* e(x) = n * s(x) */
-                    e_x *= resPtr->cpsms;
+            cell.hyperscore = thyp[t];
 
-#else
-                    status = expPtr->ModelSurvivalFunction(resPtr);
+            /* hyperscore < 0 means either b- or y- ions were not matched */
+            if (cell.hyperscore > 0)
+            {
+                if (cell.hyperscore >= MAX_HYPERSCORE)
+                    cell.hyperscore = MAX_HYPERSCORE - 1;
 
-                    /* Extract e(x) = n * s(x) = mu * 1e6 */
-                    double_t e_x = resPtr->mu;
+                cell.idxoffset = ixx;
+                cell.psid = tid[t] + pepoffset;
+                cell.sharedions = tshp[t];
 
-                    e_x /= 1e6;
+                /* Insert the cell in the heap dst */
+                resPtr->topK.insert(cell);
 
-#endif /* TAILFIT */
+                /* Increase the N */
+                resPtr->cpsms += 1;
 
-                    /* Do not print any scores just yet */
-                    if (e_x < params.expect_max)
-                    {
-                        /* Printing the scores in OpenMP mode */
-                        status = DFile_PrintScore(index, currSpecID + queries, pmass, &psm, e_x, resPtr->cpsms);
-                    }
-                }
+                /* Update the histogram */
+                resPtr->survival[(int_t) (cell.hyperscore * 10 + 0.5)] += 1;
             }
-
-            /* Reset the results */
-            resPtr->reset();
         }
-#ifdef USE_MPI
-        if (params.nodes > 1)
-            liBuff->currptr = ss->numSpecs * Xsamples * sizeof(ushort_t);
-#endif // USE_MPI
     }
 
-    // Add a thread
-#ifdef USE_MPI
-    if (params.nodes > 1)
-        AddliBuff(liBuff);
-
-#endif // USE_MPI
-
-    return status;
-}
+    /* Clear the scorecard */
+    if (sparse)
+    {
+        for (uint_t cc = 0; cc < ntouched; cc++)
+            bycPtr[touched[cc]] = scEntry();
+    }
+    else
+        std::memset(bycPtr + lclmin, 0x0, sizeof(scEntry) * csize);
 
-#ifdef USE_MPI
-void AddliBuff(ebuffer *liBuff)
-{
-    sem_wait(&qfoutlock);
-    qfout->push(liBuff);
-    sem_post(&qfoutlock);
+    ntouched = 0;
 }
-#endif // USE_MPI
 
 /*
- * FUNCTION: DSLIM_BinarySearch
+ * FUNCTION: DSLIM_Rescore
  *
- * DESCRIPTION: The Binary Search Algorithm
+ * DESCRIPTION: Second stage of the two-stage search. Rescore the
+ *              prefilter shortlist with all query peaks against the
+ *              regenerated theoretical spectra. The candidates not
+ *              in the shortlist keep their prefilter scores in the
+ *              histogram. The shortlisted candidates that do not
+ *              rescore leave both the histogram and cpsms. Resets
+ *              the prefilter results.
  *
  * INPUT:
+ * @QAPtr   : m/z of the query peaks
+ * @iPtr    : Intensities of the query peaks
+ * @qspeclen: Number of query peaks
+ * @pchg    : Precursor charge of the query
+ * @index   : The SLM Indices
+ * @sc      : Scorecard of the thread
+ * @pres    : Prefilter results (shortlist) of the query
+ * @resPtr  : Results of the query
  *
- * OUTPUT
- * none
+ * OUTPUT: none
  */
-static BOOL DSLIM_BinarySearch(Index *index, float_t precmass, int_t &minlimit, int_t &maxlimit)
+static VOID DSLIM_Rescore(spectype_t *QAPtr, spectype_t *iPtr, uint_t qspeclen, int_t pchg,
+                          Index *index, BYICount *sc, Results *pres, Results *resPtr)
 {
-    /* Get the float_t precursor mass */
-    float_t pmass1 = precmass - params.dM;
-    float_t pmass2 = precmass + params.dM;
-    pepEntry *entries = index->pepEntries;
+    const uint_t dF = params.dF;
+    const uint_t scale = params.scale;
+    const uint_t maxz = params.maxz;
+    const double_t minmass = params.min_mass;
+    const double_t maxmass = params.max_mass;
+    const bool_t matchz = params.matchz;
 
-    BOOL rv = false;
+    // static instance of the log(factorial(x)) array
+    static auto lgfact = hcp::utils::lgfact<hcp::utils::maxshp>();
 
-    uint_t min = 0;
-    uint_t max = index->lcltotCnt - 1;
+    /* Query peaks (as filtered by the query kernel) sorted by m/z */
+    std::pair<uint_t, uint_t> peaks[QALEN];
+    uint_t npeaks = 0;
 
-    if (params.dM < 0.0)
+    for (uint_t k = 0; k < qspeclen; k++)
     {
-        minlimit = min;
-        maxlimit = max;
+        uint_t qion = QAPtr[k];
 
-        return rv;
+        if (qion > dF && qion < ((maxmass * scale) - 1 - dF))
+            peaks[npeaks++] = std::make_pair(qion, (uint_t) iPtr[k]);
     }
 
-    /* Check for base case */
-    if (pmass1 < entries[min].Mass)
+    std::sort(peaks, peaks + npeaks);
+
+    /* Candidates and histogram of the prefilter */
+    resPtr->cpsms += pres->cpsms;
+
+    for (int_t h = 0; h < 2 + MAX_HYPERSCORE * 10; h++)
+        resPtr->survival[h] += pres->survival[h];
+
+    /* Rescore the shortlist in the scan order of the one-stage
+     * search so that the ties are broken the same way */
+    hCell *cells = sc->pcells;
+    const int_t ncells = pres->topK.get_size();
+
+    for (int_t c = 0; c < ncells; c++)
+        cells[c] = pres->topK.show_element(c);
+
+    std::sort(cells, cells + ncells, [](const hCell &a, const hCell &b)
+              { return (a.idxoffset != b.idxoffset) ? a.idxoffset < b.idxoffset : a.psid < b.psid; });
+
+    for (int_t c = 0; c < ncells; c++)
     {
-        minlimit = min;
+        hCell cell = cells[c];
+
+        Index *idx = index + cell.idxoffset;
+        const uint_t peplen = idx->pepIndex.peplen;
+        const uint_t nions = peplen - 1;
+        const uint_t speclen = iSERIES * maxz * nions;
+
+        pepEntry *entry = idx->pepEntries + cell.psid;
+        AA *seq = &idx->pepIndex.seqs[entry->seqID * peplen];
+
+        /* Replace the prefilter score in the histogram. A candidate
+         * that is not reinserted below leaves the sample (cpsms) too */
+        resPtr->survival[(int_t) (cell.hyperscore * 10 + 0.5)] -= 1;
+
+        /* Regenerate the theoretical spectrum as in DSLIM_ConstructChunk */
+        float_t pepMass = UTILS_GenerateSpectrum(seq, peplen, sc->spec, entry->sites, sc->ladder);
+
+        if (pepMass < minmass || pepMass > maxmass)
+        {
+            resPtr->cpsms -= 1;
+            continue;
+        }
+
+        scEntry byc = scEntry();
+
+        for (uint_t k = 0; k < speclen; k++)
+        {
+            uint_t ion = std::min(sc->spec[k], (uint_t)(maxmass * scale) - 1);
+
+            int_t isY = k / (speclen / 2);
+            int_t isB = 1 - isY;
+
+            /* Charge of the ion */
+            if (matchz && (int_t)((k / nions) % maxz) + 1 > pchg)
+                continue;
+
+            /* All query peaks within dF of the ion */
+            auto pk = std::lower_bound(peaks, peaks + npeaks, std::make_pair(ion - std::min(ion, dF), 0u));
+
+            for (; pk < peaks + npeaks && pk->first <= ion + dF; pk++)
+                SC_Add(byc, isB, isY, pk->second);
+        }
+
+        ushort_t bcc = SC_BCount(byc);
+        ushort_t ycc = SC_YCount(byc);
+        ushort_t shpk = bcc + ycc;
+
+        /* Scored as in DSLIM_QueryKernel */
+        if (shpk >= params.min_shp)
+        {
+            cell.hyperscore = lgfact[bcc] + lgfact[ycc] + hcp::utils::log10p1(SC_BIntn(byc))
+                              + hcp::utils::log10p1(SC_YIntn(byc)) - 4;
+
+            if (cell.hyperscore > 0)
+            {
+                if (cell.hyperscore >= MAX_HYPERSCORE)
+                    cell.hyperscore = MAX_HYPERSCORE - 1;
+
+                cell.sharedions = shpk;
+
+                /* Insert the cell in the heap dst */
+                resPtr->topK.insert(cell);
+
+                /* Update the histogram */
+                resPtr->survival[(int_t) (cell.hyperscore * 10 + 0.5)] += 1;
+
+                continue;
+            }
+        }
+
+        /* Not a candidate of the one-stage search either */
+        resPtr->cpsms -= 1;
     }
-    else if (pmass1 > entries[max].Mass)
+
+    /* Reset the prefilter results */
+    pres->reset();
+}
+
+/*
+ * FUNCTION: DSLIM_QueryResults
+ *
+ * DESCRIPTION: Model the e-value of the top PSM of a query and
+ *              print it (or transmit the partial results in the
+ *              distributed memory mode). Resets the results.
+ *
+ * INPUT:
+ * @ss        : The batch of query spectra
+ * @index     : The SLM Indices
+ * @queries   : Query number in the batch
+ * @currSpecID: ID of the first query in the batch
+ * @resPtr    : Results of the query
+ * @expPtr    : expeRT instance of the thread
+ * @txArray   : Partial results to transmit
+ * @liBuff    : Buffer for the partial results
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+static status_t DSLIM_QueryResults(Queries<spectype_t> *ss, Index *index, int_t queries, int currSpecID,
+                                   Results *resPtr, expeRT *expPtr, partRes *txArray, ebuffer *liBuff)
+{
+    status_t status = SLM_SUCCESS;
+    float_t pmass = ss->precurse[queries];
+    auto    pchg  = ss->charges[queries];
+    auto    rtime = ss->rtimes[queries];
+
+#ifndef USE_MPI
+    UNUSED_PARAM(txArray);
+    UNUSED_PARAM(liBuff);
+#endif /* USE_MPI */
+
+#ifdef USE_MPI
+    /* Distributed memory mode - Model partial Gumbel
+     * and transmit parameters to rx machine */
+    if (params.nodes > 1)
     {
-        minlimit = max;
-        maxlimit = max;
-        return rv;
+        /* Set the params.min_cpsm in dist mem mode to 1 */
+        if (resPtr->cpsms >= 1)
+        {
+            /* Extract the top PSM */
+            hCell psm = resPtr->topK.getMax();
+
+            psm.pmass = pmass;
+            psm.pchg = pchg;
+            psm.rtime = rtime;
+            psm.fileIndex = ss->fileNum;
+
+            /* Put it in the list */
+            CandidatePSMS[currSpecID + queries] = psm;
+
+            resPtr->maxhypscore = (psm.hyperscore * 10 + 0.5);
+
+            status = expPtr->StoreIResults(resPtr, queries, liBuff);
+
+            /* Fill in the Tx array cells */
+            txArray[queries].min  = resPtr->minhypscore;
+            txArray[queries].max2 = resPtr->nexthypscore;
+            txArray[queries].max  = psm.hyperscore;
+            txArray[queries].N    = resPtr->cpsms;
+            txArray[queries].qID  = currSpecID + queries;
+        }
+        else
+        {
+            /* Extract the top result
+             * and put it in the list */
+            CandidatePSMS[currSpecID + queries] = 0;
+
+            /* Get the handle to the txArr
+             * Fill it up and move on */
+            txArray[queries] = 0;
+            txArray[queries].qID  = currSpecID + queries;
+        }
     }
+
+    /* Shared memory mode - Do complete
+     * modeling and print results */
     else
+#endif /* USE_MPI */
     {
-        /* Find the minlimit here */
-        minlimit = DSLIM_BinFindMin(entries, pmass1, min, max);
+        /* Check for minimum number of PSMs */
+        if (resPtr->cpsms >= params.min_cpsm)
+        {
+            /* Extract the top PSM */
+            hCell psm = resPtr->topK.getMax();
+
+            psm.pmass = pmass;
+            psm.pchg = pchg;
+            psm.rtime = rtime;
+            psm.fileIndex = ss->fileNum;
+
+            resPtr->maxhypscore = (psm.hyperscore * 10 + 0.5);
+
+            /* Compute expect score if there
+             * are any candidate PSMs */
+#ifdef TAILFIT
+            status = expPtr->ModelTailFit(resPtr);
+
+            /* Linear Regression Parameters */
+            double_t w = resPtr->mu;
+            double_t b = resPtr->beta;
+
+            w /= 1e6;
+            b /= 1e6;
+
+            /* Estimate the log (s(x)); x = log(hyperscore) */
+            double_t lgs_x = (w * resPtr->maxhypscore) + b;
+
+            /* Compute the s(x) */
+            double_t e_x = pow(10, lgs_x);
+
+            /* e(x) = n * s(x) */
+            e_x *= resPtr->cpsms;
+
+#else
+            status = expPtr->ModelSurvivalFunction(resPtr);
+
+            /* Extract e(x) = n * s(x) = mu * 1e6 */
+            double_t e_x = resPtr->mu;
+
+            e_x /= 1e6;
+
+#endif /* TAILFIT */
+
+            /* Do not print any scores just yet */
+            if (e_x < params.expect_max)
+            {
+                /* Printing the scores in OpenMP mode */
+                status = DFile_PrintScore(index, currSpecID + queries, pmass, &psm, e_x, resPtr->cpsms);
+            }
+        }
     }
 
-    min = 0;
-    max = index->lcltotCnt - 1;
+    /* Reset the results */
+    resPtr->reset();
+
+    return status;
+}
+
+/*
+ * FUNCTION: DSLIM_PrepareBatch
+ *
+ * DESCRIPTION: Set up a batch of queries for the search: the
+ *              search units and the partial results buffer
+ *
+ * INPUT:
+ * @batch : The batch to set up
+ * @ss    : The batch of query spectra
+ * @specID: ID of the first query in the batch
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+static status_t DSLIM_PrepareBatch(qbatch_t *batch, Queries<spectype_t> *ss, int_t specID)
+{
+    status_t status = SLM_SUCCESS;
 
+    batch->ss = ss;
+    batch->specID = specID;
+    batch->liBuff = nullptr;
+    batch->txArray = nullptr;
 
-    /* Check for base case */
-    if (pmass2 > entries[max].Mass)
+    if (params.nodes > 1)
     {
-        maxlimit = max;
+        batch->liBuff = new ebuffer;
+
+        batch->txArray = batch->liBuff->packs;
+        batch->liBuff->isDone = false;
+        batch->liBuff->batchNum = ss->batchNum;
     }
-    else if (pmass2 < entries[min].Mass)
+
+    /* Sanity checks */
+    if (Score == nullptr || (batch->txArray == nullptr && params.nodes > 1))
+        status = ERR_INVLD_MEMORY;
+
+    batch->order.clear();
+    batch->groups.clear();
+
+    if (params.chunkmajor)
     {
-        minlimit = min;
-        maxlimit = min;
-        return rv;
+        /* Visit the queries in the order of precursor mass */
+        batch->order.resize(ss->numSpecs);
+        std::iota(batch->order.begin(), batch->order.end(), 0);
+
+        std::stable_sort(batch->order.begin(), batch->order.end(), [&](int_t a, int_t b)
+                         { return ss->precurse[a] < ss->precurse[b]; });
+
+        /* Group (up to QGROUPSIZE) queries whose precursor
+         * windows overlap the window of the first query */
+        auto &order = batch->order;
+        auto &groups = batch->groups;
+
+        for (int_t i = 0; i < ss->numSpecs; i++)
+        {
+            if (groups.empty() || i - groups.back() == QGROUPSIZE ||
+                ss->precurse[order[i]] - params.dM > ss->precurse[order[groups.back()]] + params.dM)
+                groups.push_back(i);
+        }
+
+        groups.push_back(ss->numSpecs);
+
+        batch->nunits = groups.size() - 1;
     }
     else
-    {
-        /* Find the maxlimit here */
-        maxlimit = DSLIM_BinFindMax(entries, pmass2, min, max);
-    }
+        batch->nunits = ss->numSpecs;
 
-    if (entries[maxlimit].Mass <= pmass2 && entries[minlimit].Mass >= pmass1)
-        rv = true;
+    batch->left = batch->nunits;
 
-    return rv;
+    return status;
 }
 
-
-static int_t DSLIM_BinFindMin(pepEntry *entries, float_t pmass1, int_t min, int_t max)
+/*
+ * FUNCTION: DSLIM_QueryUnits
+ *
+ * DESCRIPTION: Search a range of the units of a batch with the
+ *              scorecard and expeRT of the calling OpenMP thread
+ *
+ * INPUT:
+ * @batch   : The batch
+ * @index   : The SLM Indices
+ * @idxchunk: Number of SLM Indices
+ * @first   : First unit to search
+ * @last    : One past the last unit to search
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+static status_t DSLIM_QueryUnits(qbatch_t *batch, Index *index, uint_t idxchunk, int_t first, int_t last)
 {
-    int_t half = (min + max)/2;
+    status_t status = SLM_SUCCESS;
+    Queries<spectype_t> *ss = batch->ss;
+    auto thno = omp_get_thread_num();
+
+    BYICount *sc    = Score + thno;
+    expeRT  *expPtr = ePtrs + thno;
 
-    if (max - min < 20)
+    if (params.chunkmajor)
     {
-        int_t current = min;
+        Results *gres = Score[thno].gres;
 
-        while (entries[current].Mass < pmass1)
-            current++;
+        /* Process each (length, chunk) for the whole group
+         * so that its bA and iA stay in cache across queries */
+        for (int_t grp = first; grp < last; grp++)
+        {
+            const int_t gfirst = batch->groups[grp];
+            const int_t gsize = batch->groups[grp + 1] - gfirst;
+            const int_t *gq = batch->order.data() + gfirst;
 
-        return current;
-    }
+            int_t minlimits[QGROUPSIZE];
+            int_t maxlimits[QGROUPSIZE];
+            BOOL  valid[QGROUPSIZE];
 
-    if (pmass1 > entries[half].Mass)
-    {
-        min = half;
-        return DSLIM_BinFindMin(entries, pmass1, min, max);
+#if defined (PROGRESS)
+            if (thno == 0 && params.myid == 0)
+                std::cout << "\rDONE:\t\t" << (gfirst * 100) /ss->numSpecs << "%";
+#endif // PROGRESS
+
+            for (uint_t ixx = 0; ixx < idxchunk; ixx++)
+            {
+                /* The precursor windows are the same for all chunks */
+                for (int_t q = 0; q < gsize; q++)
+                {
+                    valid[q] = DSLIM_PrecursorWindow(index + ixx, ss->precurse[gq[q]], minlimits[q], maxlimits[q]);
+                    valid[q] = valid[q] && (maxlimits[q] >= minlimits[q]);
+                }
+
+                for (uint_t chno = 0; chno < index[ixx].nChunks; chno++)
+                {
+                    for (int_t q = 0; q < gsize; q++)
+                    {
+                        if (!valid[q])
+                            continue;
+
+                        const int_t queries = gq[q];
+                        const uint_t qspeclen = ss->idx[queries + 1] - ss->idx[queries];
+
+                        /* Two-stage search: shortlist with the top (last) peaks only */
+                        const uint_t pfoff = (params.prefilter && qspeclen > params.prefilter) ?
+                                             qspeclen - params.prefilter : 0;
+
+                        DSLIM_QueryChunk(ss->moz + ss->idx[queries] + pfoff, ss->intensity + ss->idx[queries] + pfoff,
+                                         qspeclen - pfoff, ss->charges[queries],
+                                         index, ixx, chno, minlimits[q], maxlimits[q], sc,
+                                         (pfoff) ? sc->pres + q : gres + q);
+                    }
+                }
+            }
+
+            for (int_t q = 0; q < gsize; q++)
+            {
+                const int_t queries = gq[q];
+                const uint_t qspeclen = ss->idx[queries + 1] - ss->idx[queries];
+
+                /* Rescore the shortlist with all peaks */
+                if (params.prefilter && qspeclen > params.prefilter)
+                    DSLIM_Rescore(ss->moz + ss->idx[queries], ss->intensity + ss->idx[queries], qspeclen,
+                                  ss->charges[queries], index, sc, sc->pres + q, gres + q);
+
+                status = DSLIM_QueryResults(ss, index, queries, batch->specID, gres + q, expPtr,
+                                            batch->txArray, batch->liBuff);
+            }
+        }
     }
-    else if (pmass1 < entries[half].Mass)
+    else
     {
-        max = half;
-        return DSLIM_BinFindMin(entries, pmass1, min, max);
-    }
+        Results *resPtr = &Score[thno].res;
 
-    if (pmass1 == entries[half].Mass)
-    {
-        while (pmass1 == entries[half].Mass)
-            half--;
+        for (int_t queries = first; queries < last; queries++)
+        {
+            /* Pointer to each query spectrum */
+            auto *QAPtr = ss->moz + ss->idx[queries];
+            float_t pmass = ss->precurse[queries];
+            auto    pchg  = ss->charges[queries];
+            auto    *iPtr = ss->intensity + ss->idx[queries];
+            auto qspeclen = ss->idx[queries + 1] - ss->idx[queries];
+
+            /* Two-stage search: shortlist with the top (last) peaks only */
+            const uint_t pfoff = (params.prefilter && qspeclen > params.prefilter) ?
+                                 qspeclen - params.prefilter : 0;
+
+            Results *qres = (pfoff) ? sc->pres : resPtr;
 
-        half++;
+#if defined (PROGRESS)
+            if (thno == 0 && params.myid == 0)
+                std::cout << "\rDONE:\t\t" << (queries * 100) /ss->numSpecs << "%";
+#endif // PROGRESS
+
+            for (uint_t ixx = 0; ixx < idxchunk; ixx++)
+            {
+                int_t minlimit = 0;
+                int_t maxlimit = 0;
+
+                /* The precursor window is the same for all chunks */
+                BOOL val = DSLIM_PrecursorWindow(index + ixx, pmass, minlimit, maxlimit);
+
+                /* Spectrum violates limits */
+                if (val == false || (maxlimit < minlimit))
+                    continue;
+
+                for (uint_t chno = 0; chno < index[ixx].nChunks; chno++)
+                    DSLIM_QueryChunk(QAPtr + pfoff, iPtr + pfoff, qspeclen - pfoff, pchg, index, ixx, chno,
+                                     minlimit, maxlimit, sc, qres);
+            }
+
+            /* Rescore the shortlist with all peaks */
+            if (pfoff)
+                DSLIM_Rescore(QAPtr, iPtr, qspeclen, pchg, index, sc, qres, resPtr);
+
+            status = DSLIM_QueryResults(ss, index, queries, batch->specID, resPtr, expPtr,
+                                        batch->txArray, batch->liBuff);
+        }
     }
 
-    return half;
+    return status;
+}
+
+/*
+ * FUNCTION: DSLIM_FinishBatch
+ *
+ * DESCRIPTION: Hand the partial results of a searched
+ *              batch over to the file output threads
+ *
+ * INPUT:
+ * @batch: The searched batch
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+static status_t DSLIM_FinishBatch(qbatch_t *batch)
+{
+#ifdef USE_MPI
+    if (params.nodes > 1)
+    {
+        batch->liBuff->currptr = batch->ss->numSpecs * Xsamples * sizeof(ushort_t);
+        AddliBuff(batch->liBuff);
+    }
+#endif // USE_MPI
 
+    batch->liBuff = nullptr;
+    batch->txArray = nullptr;
 
+    return SLM_SUCCESS;
 }
 
-static int_t DSLIM_BinFindMax(pepEntry *entries, float_t pmass2, int_t min, int_t max)
+/*
+ * FUNCTION: DSLIM_SplitTask
+ *
+ * DESCRIPTION: Split a task of the search runtime lazily. Ranges
+ *              larger than the grain are halved, leaving the upper
+ *              halves in the deque of the worker for the thieves
+ *
+ * INPUT:
+ * @dq  : Deque of the calling worker
+ * @task: The task, set to the part to run
+ *
+ * OUTPUT:
+ * @pushed: Were any halves pushed?
+ */
+static bool_t DSLIM_SplitTask(wsdeque<WSQSIZE> *dq, ull_t &task)
 {
-    int_t half = (min + max)/2;
+    const int_t slot  = WSSLOT(task);
+    const int_t grain = (params.chunkmajor) ? 1 : WSGRAIN;
+    const int_t first = WSFIRST(task);
+    int_t last  = WSLAST(task);
+    bool_t pushed = false;
 
-    if (max - min < 20)
+    while (last - first > grain)
     {
-        int_t current = max;
+        int_t mid = first + (last - first) / 2;
 
-        while (entries[current].Mass > pmass2)
-            current--;
+        if (!dq->push(WSTASK(slot, mid, last)))
+            break;
 
-        return current;
+        last = mid;
+        pushed = true;
     }
 
-    if (pmass2 > entries[half].Mass)
+    task = WSTASK(slot, first, last);
+
+    return pushed;
+}
+
+/*
+ * FUNCTION: DSLIM_SearchTask
+ *
+ * DESCRIPTION: Run a (split) task of the search runtime
+ *
+ * INPUT:
+ * @batches : The batch slots
+ * @task    : The task
+ * @index   : The SLM Indices
+ * @idxchunk: Number of SLM Indices
+ * @done    : Set if the task completed its batch
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+static status_t DSLIM_SearchTask(qbatch_t *batches, ull_t task, Index *index, uint_t idxchunk, bool_t &done)
+{
+    const int_t slot  = WSSLOT(task);
+    const int_t first = WSFIRST(task);
+    const int_t last  = WSLAST(task);
+
+    status_t status = DSLIM_QueryUnits(batches + slot, index, idxchunk, first, last);
+
+    /* The worker to search the last units completes the batch */
+    done = (batches[slot].left.fetch_sub(last - first) == last - first);
+
+    return status;
+}
+
+#ifdef USE_MPI
+void AddliBuff(ebuffer *liBuff)
+{
+    qfout->bpush(liBuff);
+}
+#endif // USE_MPI
+
+/*
+ * FUNCTION: DSLIM_PrecursorWindow
+ *
+ * DESCRIPTION: Locate the pepEntries within the precursor mass
+ *              tolerance using the mass bucket directory. The
+ *              window starts from the bucket of each bound and
+ *              is refined by a short scan over pepMass. Indices
+ *              whose mass range can't match are skipped upfront.
+ *
+ * INPUT:
+ * @index   : The SLM Index
+ * @precmass: Precursor mass of the query
+ * @minlimit: First entry with mass >= precmass - dM
+ * @maxlimit: Last entry with mass <= precmass + dM
+ *
+ * OUTPUT:
+ * @valid: false if the window is outside the index
+ */
+static BOOL DSLIM_PrecursorWindow(Index *index, float_t precmass, int_t &minlimit, int_t &maxlimit)
+{
+    /* Get the float_t precursor mass */
+    float_t pmass1 = precmass - params.dM;
+    float_t pmass2 = precmass + params.dM;
+
+    const float_t *mass = index->pepMass;
+    const uint_t *dir = index->massDir;
+    const int_t count = index->lcltotCnt;
+    const int_t nbkts = index->nmassDir;
+
+    if (params.dM < 0.0)
     {
-        min = half;
-        return DSLIM_BinFindMax(entries, pmass2, min, max);
+        minlimit = 0;
+        maxlimit = count - 1;
+
+        return false;
     }
-    else if (pmass2 < entries[half].Mass)
+
+    /* Mass range of the index doesn't overlap the window */
+    if (pmass1 > index->maxMass || pmass2 < index->minMass)
     {
-        max = half;
-        return DSLIM_BinFindMax(entries, pmass2, min, max);
+        minlimit = 0;
+        maxlimit = -1;
+
+        return false;
     }
 
-    if (pmass2 == entries[half].Mass)
-    {
-        half++;
+    /* Lower bound of pmass1 */
+    int_t b1 = std::min(std::max(MASSBUCKET(pmass1), 0), nbkts);
+    int_t lo = dir[b1];
 
-        while (pmass2 == entries[half].Mass)
-            half++;
+    while (lo < count && mass[lo] < pmass1)
+        lo++;
 
-        half--;
-    }
+    /* Upper bound of pmass2 */
+    int_t b2 = std::min(std::max(MASSBUCKET(pmass2), 0), nbkts);
+    int_t hi = dir[b2];
+
+    while (hi < count && mass[hi] <= pmass2)
+        hi++;
+
+    minlimit = lo;
+    maxlimit = hi - 1;
+
+    /* Window outside the index */
+    return (lo < count && hi > 0);
+}
+
+/*
+ * FUNCTION: DSLIM_SkipLowerBound
+ *
+ * DESCRIPTION: Lower bound of key in iA[start, end) using the skip
+ *              directory (sA[k] = iA[k * SKIPSTRIDE]). Only the samples
+ *              inside the bin are searched followed by a linear scan
+ *              of at most SKIPSTRIDE (one cache line) iA entries.
+ *
+ * INPUT:
+ * @iA   : Ions Array
+ * @sA   : Skip directory of the iA
+ * @start: Start of the bin
+ * @end  : End of the bin
+ * @key  : The value to search
+ *
+ * OUTPUT:
+ * @pos: Position of the first iA entry >= key in [start, end]
+ */
+static inline uint_t DSLIM_SkipLowerBound(const uint_t *iA, const uint_t *sA, uint_t start, uint_t end, uint_t key)
+{
+    /* Samples that fall inside the bin */
+    uint_t s0 = SKIPSIZE(start);
+    uint_t s1 = SKIPSIZE(end);
 
-    return half;
+    /* First sample >= key */
+    uint_t sk = std::lower_bound(sA + s0, sA + s1, key) - sA;
 
+    /* The lower bound lies in (previous sample, this sample] */
+    uint_t lo = (sk > s0) ? ((sk - 1) * SKIPSTRIDE) + 1 : start;
+    uint_t hi = (sk < s1) ? (sk * SKIPSTRIDE) : end;
+
+    while (lo < hi && iA[lo] < key)
+        lo++;
+
+    return lo;
 }
+
 /*
  * FUNCTION: DSLIM_IO_Threads_Entry
  *
- * DESCRIPTION: Entry function for all
- *              I/O threads
+ * DESCRIPTION: Entry function for all I/O threads. Runs
+ *              on a pooled worker each time the Scheduler
+ *              dispatches it, until it retires or is preempted
  *
  * INPUT:
  * @argv: Pointer to void arguments
@@ -1258,6 +2077,7 @@ VOID DSLIM_IO_Threads_Entry()
     Queries<spectype_t> *ioPtr = nullptr;
     bool eSignal = false;
     bool preempt = false;
+    bool retired = false;
 
     // TODO: verify thread local performance
 #if defined (USE_TIMEMORY)
@@ -1271,7 +2091,9 @@ VOID DSLIM_IO_Threads_Entry()
 
     int_t rem_spec = 0;
 
-    while (!scheduler_init) { usleep(1); }
+    /* Sleep until the SchedHandle is set and wake the next */
+    sem_wait(&schedinit);
+    sem_post(&schedinit);
 
     /* Initialize and process Query Spectra */
     for (;status == SLM_SUCCESS;)
@@ -1280,28 +2102,15 @@ VOID DSLIM_IO_Threads_Entry()
         if (Query == nullptr || Query->isDeInit())
         {
             /* Try getting the Query object from queue if present */
-            sem_wait(&ioQlock);
-
-            if (!ioQ->isEmpty())
-            {
-                Query = ioQ->front();
-                status = ioQ->pop();
-            }
-
-            sem_post(&ioQlock);
+            if (ioQ->pop(Query) != SLM_SUCCESS)
+                Query = nullptr;
 
             /* If the queue is empty */
             if (Query == nullptr || Query->isDeInit())
             {
                 /* Otherwise, initialize the object from a file */
-                /* lock the query file */
-                sem_wait(&qfilelock);
-
-                /* Check if anymore query file pointers */
-                if (!qfPtrs->isEmpty())
+                if (qfPtrs->pop(Query) == SLM_SUCCESS)
                 {
-                    Query = qfPtrs->front();
-                    qfPtrs->pop();
                     // Init to 1 for first loop to run
                     rem_spec = Query->getQAcount();
                 }
@@ -1310,46 +2119,49 @@ VOID DSLIM_IO_Threads_Entry()
                     // Raise the exit signal
                     eSignal = true;
                 }
-
-                /* Unlock the query file */
-                sem_post(&qfilelock);
             }
         }
 
         /* If no more files, then break the inf loop */
         if (eSignal == true)
+        {
+            SchedHandle->takeControl();
+            retired = true;
+
+            /* A preempted thread may have parked its Query */
+            status = DSLIM_Dispatch_IO();
+
             break;
+        }
 
         /*********************************************
          * At this point, we have the data ready     *
          *********************************************/
 
-        /* Wait for a I/O request */
-        status = qPtrs->lockw_();
-        sem_wait(&ioQlock);
-
-        /* Empty wait queue or Scheduler preemption signal raised  */
+        /* Scheduler preemption signal raised */
         preempt = SchedHandle->checkPreempt();
 
-        if (qPtrs->isEmptyWaitQ() || preempt)
-        {
-            status = qPtrs->unlockw_();
+        /* Otherwise, get the I/O ptr from the wait queue */
+        ioPtr = preempt ? nullptr : qPtrs->getIOPtr();
 
+        /* Empty wait queue or preempted */
+        if (ioPtr == nullptr)
+        {
+            /* Park the Query for the next I/O thread */
             status = ioQ->push(Query);
 
-            sem_post(&ioQlock);
+            if (!preempt)
+                SchedHandle->takeControl();
+
+            retired = true;
+
+            /* A buffer may have been returned meanwhile */
+            status = DSLIM_Dispatch_IO();
 
             /* Break from loop */
             break;
         }
 
-        sem_post(&ioQlock);
-
-        /* Otherwise, get the I/O ptr from the wait queue */
-        ioPtr = qPtrs->getIOPtr();
-
-        status = qPtrs->unlockw_();
-
         /* Reset the ioPtr */
         ioPtr->reset();
 
@@ -1361,14 +2173,13 @@ VOID DSLIM_IO_Threads_Entry()
         ioPtr->fileNum  = Query->getQfileIndex();
         Query->Curr_chunk()++;
 
-        /* Lock the ready queue */
-        qPtrs->lockr_();
-
 #ifdef USE_MPI
         if (params.nodes > 1)
         {
             /* Add an entry of the added buffer to the CommHandle */
+            sem_wait(&commlock);
             status = CommHandle->AddBatch(ioPtr->batchNum,ioPtr->numSpecs, Query->getQfileIndex());
+            sem_post(&commlock);
         }
 #endif /* USE_MPI */
 
@@ -1377,9 +2188,6 @@ VOID DSLIM_IO_Threads_Entry()
          *************************************/
         qPtrs->IODone(ioPtr);
 
-        /* Unlock the ready queue */
-        qPtrs->unlockr_();
-
         /* If no more remaining spectra, then deinit */
         if (rem_spec < 1)
         {
@@ -1398,7 +2206,7 @@ VOID DSLIM_IO_Threads_Entry()
     prep_inst.stop();
 #endif // USE_TIMEMORY
 
-    if (!preempt)
+    if (!retired)
         /* Request pre-emption */
         SchedHandle->takeControl();
 }
@@ -1409,25 +2217,9 @@ VOID DSLIM_FOut_Thread_Entry()
     int_t batchSize = 0;
     ebuffer *lbuff = nullptr;
 
-    for (;;usleep(1))
+    /* Sleep until a buffer arrives or the queue is closed */
+    while (qfout->bpop(lbuff) == SLM_SUCCESS)
     {
-        sem_wait(&qfoutlock);
-
-        if (qfout->isEmpty())
-        {
-            sem_post(&qfoutlock);
-
-            if (exitSignal)
-                return;
-
-            continue;
-        }
-
-        lbuff = qfout->front();
-        qfout->pop();
-
-        sem_post(&qfoutlock);
-
         ofstream *fh = new ofstream;
         string_t fn = params.workspace + "/" +
                     std::to_string(lbuff->batchNum) +
@@ -1449,6 +2241,9 @@ static inline status_t DSLIM_Deinit_IO()
 
     Queries<spectype_t> *ptr = nullptr;
 
+    /* No more batches: release any thread still waiting for one */
+    qPtrs->shutdown();
+
     while (!qPtrs->isEmptyReadyQ())
     {
         ptr = qPtrs->getWorkPtr();
@@ -1471,6 +2266,10 @@ static inline status_t DSLIM_Deinit_IO()
         }
     }
 
+    /* Join the I/O workers before their queues go */
+    delete SchedHandle;
+    SchedHandle = nullptr;
+
     /* Delete the qPtrs buffer handle */
     delete qPtrs;
 
@@ -1480,9 +2279,5 @@ static inline status_t DSLIM_Deinit_IO()
     delete ioQ;
     ioQ = nullptr;
 
-    /* Destroy the ioQ lock semaphore */
-    status = sem_destroy(&qfilelock);
-    status = sem_destroy(&ioQlock);
-
     return status;
 }
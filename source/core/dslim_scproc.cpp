@@ -33,7 +33,8 @@ BOOL         isCarried   = false;
 BData       *bdata       = NULL;
 extern gParams           params;
 
-std::atomic<bool> score_init(false);
+/* Posted once the ScoreHandle is set up */
+lock_t score_init;
 
 #ifdef USE_MPI
 /* Entry function for DSLIM_Score module */
@@ -88,12 +89,16 @@ status_t DSLIM_DistScoreManager()
         //
         if (status == SLM_SUCCESS)
         {
+            /* The score thread started by DSLIM_Score
+             * sleeps on score_init until the handle is set */
+            sem_init(&score_init, 0, 0);
+
             ScoreHandle = new DSLIM_Score(bdata);
 
             if (ScoreHandle == NULL)
                 status = ERR_INVLD_MEMORY;
             else
-                score_init = true;
+                sem_post(&score_init);
         }
 
         //
@@ -237,7 +242,7 @@ VOID DSLIM_Score_Thread_Entry()
 
     /* Avoid race conditions by waiting for
      * ScoreHandle pointer to initialize */
-    while (!score_init) { usleep(1); }
+    sem_wait(&score_init);
 
     if (rxRqsts != NULL && rxStats != NULL)
         ScoreHandle->RXSizes(rxRqsts, rxStats);
@@ -107,23 +107,7 @@ inline dvector expeRT::vrange(int_t stt, int_t end)
 
 // -------------------------------------------------------------------------------------------- //
 
-inline darray expeRT::arange(int_t stt, int_t end)
-{
-    darray xx (end-stt+1);
-
-    int_t k = stt;
-
-    for (auto &r : xx)
-    {
-        r = k;
-        k++;
-    }
-
-    return xx;
-}
-
-// -------------------------------------------------------------------------------------------- //
-
+CPU_KERNEL
 status_t expeRT::ModelSurvivalFunction(Results *rPtr)
 {
     status_t status = SLM_SUCCESS;
@@ -266,6 +250,7 @@ status_t expeRT::ModelSurvivalFunction(Results *rPtr)
 
 // -------------------------------------------------------------------------------------------- //
 
+CPU_KERNEL
 status_t expeRT::ModelSurvivalFunction(double_t &eValue, const int_t max1)
 {
     status_t status = SLM_SUCCESS;
@@ -393,6 +378,7 @@ status_t expeRT::ModelSurvivalFunction(double_t &eValue, const int_t max1)
 
 // -------------------------------------------------------------------------------------------- //
 
+CPU_KERNEL
 status_t expeRT::ModelTailFit(Results *rPtr)
 {
     status_t status = SLM_SUCCESS;
@@ -560,6 +546,7 @@ status_t expeRT::ModelTailFit(Results *rPtr)
 
 // -------------------------------------------------------------------------------------------- //
 
+CPU_KERNEL
 status_t expeRT::ModelTailFit(double_t &eValue, const int_t max1)
 {
     status_t status = SLM_SUCCESS;
@@ -863,6 +850,7 @@ status_t expeRT::Reconstruct(ebuffer *ebs, int_t specno, partRes *fR, double *ta
 
 // -------------------------------------------------------------------------------------------- //
 
+CPU_KERNEL
 status_t expeRT::Model_logWeibull(Results *rPtr)
 {
     status_t status = SLM_SUCCESS;
@@ -1062,52 +1050,97 @@ status_t expeRT::AddlogWeibull(int_t N, double_t mu, double_t beta, int_t Min, i
 
 // -------------------------------------------------------------------------------------------- //
 
-inline double_t expeRT::MeanSqError(const darray &y) { return (y * y).sum(); }
+CPU_KERNEL
+double_t expeRT::logWeibullError(const double_t *y, int_t s, int_t e, double_t mu, double_t beta)
+{
+    double_t err = 0;
+
+    for (auto x = s; x <= e; x++)
+    {
+        const double_t z = (x - mu) / beta;
+        const double_t r = y[x - s] - (1/beta) * exp(-(z + exp(-z)));
+
+        err += r * r;
+    }
+
+    return err;
+}
 
 // -------------------------------------------------------------------------------------------- //
 
-double_t expeRT::logWeibullFit(lwvector<double_t> *yy, int_t s, int_t e, int_t niter, double_t lr, double_t cutoff)
+CPU_KERNEL
+double_t expeRT::logWeibullFit(lwvector<double_t> *yy, int_t s, int_t e, int_t niter, double_t cutoff)
 {
-    double_t curerr = INFINITY;
+    const double_t *y = yy->data();
 
     beta_t = 4.0;
 
-    const darray y(yy->data(), yy->Size());
-    const darray X1(arange(s, e));
+    double_t curerr = logWeibullError(y, s, e, mu_t, beta_t);
 
-    for (auto i = 0; i < niter; i++)
+    /* Levenberg-Marquardt damping */
+    double_t lambda = 1e-3;
+
+    for (auto i = 0; i < niter && curerr >= cutoff; i++)
     {
-        /* Gumbel distribution response */
-        darray h_x(alogWeibullResponse(mu_t, beta_t, s, e));
+        /* Accumulate J'J and J'r for the residuals r = y - h(x) */
+        double_t jmm = 0, jmb = 0, jbb = 0;
+        double_t gm = 0, gb = 0;
 
-        /* Difference */
-        darray diff = y - h_x;
+        for (auto x = s; x <= e; x++)
+        {
+            const double_t z = (x - mu_t) / beta_t;
+            const double_t w = exp(-z);
+            const double_t h = (1/beta_t) * exp(-(z + w));
+            const double_t r = y[x - s] - h;
+
+            /* Partial derivatives of h w.r.t. mu and beta */
+            const double_t dm = h * (1 - w) / beta_t;
+            const double_t db = h * (z * (1 - w) - 1) / beta_t;
+
+            jmm += dm * dm;
+            jmb += dm * db;
+            jbb += db * db;
+            gm  += dm * r;
+            gb  += db * r;
+        }
 
-        /* Current error */
-        curerr = MeanSqError(diff);
+        BOOL improved = false;
 
-        /* Check for break condition */
-        if (curerr < cutoff)
+        /* Increase the damping until the step reduces the error */
+        while (lambda < 1e10)
         {
-            break;
-        }
+            const double_t amm = jmm * (1 + lambda);
+            const double_t abb = jbb * (1 + lambda);
+            const double_t det = amm * abb - jmb * jmb;
 
-        /* Compute the partial derivatives */
-        darray b = -h_x/(beta_t);
-        darray c = (mu_t - X1)/beta_t - (mu_t-X1)/beta_t * exp((mu_t - X1)/beta_t);
+            if (det > 0)
+            {
+                const double_t nmu = mu_t + (abb * gm - jmb * gb) / det;
+                const double_t nbeta = beta_t + (amm * gb - jmb * gm) / det;
 
-        b = b + b * c;
+                if (nbeta > 0)
+                {
+                    const double_t nerr = logWeibullError(y, s, e, nmu, nbeta);
 
-        auto d = (diff * b).sum();
+                    if (nerr < curerr)
+                    {
+                        improved = (curerr - nerr) > (curerr * 1e-9);
 
-        darray e = h_x/beta_t;
-        e = (e - e * exp((mu_t - X1)/beta_t));
+                        mu_t = nmu;
+                        beta_t = nbeta;
+                        curerr = nerr;
+                        lambda = std::max(lambda / 10, 1e-12);
+                        break;
+                    }
+                }
+            }
 
-        auto ee = (diff * e).sum();
+            lambda *= 10;
+        }
 
-        /* Update the mu and beta */
-        mu_t   += lr * ee;
-        beta_t += lr * d;
+        /* Converged */
+        if (!improved)
+            break;
     }
 
     return curerr;
@@ -1132,19 +1165,6 @@ inline VOID expeRT::logWeibullResponse(double_t mu, double_t beta, int_t st, int
 
 // -------------------------------------------------------------------------------------------- //
 
-inline darray expeRT::alogWeibullResponse(double_t mu, double_t beta, int_t st, int_t en)
-{
-    darray xx = arange(st, en);
-
-    darray z = (xx - mu)/beta;
-
-    xx =  (1/beta) * exp(-(z + exp(-z)));
-
-    return xx;
-}
-
-// -------------------------------------------------------------------------------------------- //
-
 template <class T>
 inline int_t expeRT::rargmax(T &data, int_t i1, int_t i2, double_t value)
 {
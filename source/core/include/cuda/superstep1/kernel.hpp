@@ -51,7 +51,7 @@ void SortPeptideIndex(Index *index);
 status_t ConstructIndexChunk(Index *index, int_t chunk_number, bool isSearch = false);
 
 // kernel to stable sort the fragment-ion data
-void StableKeyValueSort(uint_t *keys, uint_t* data, int size);
+void StableKeyValueSort(uint_t *keys, uint_t* data, int size, uint_t speclen, uint_t peplen_1, uint_t maxz, bool isSearch = false);
 
 // free the device memory allocated for the fragment ion data
 void freeFragIon();
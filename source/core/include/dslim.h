@@ -24,6 +24,7 @@
 #include "lbe.h"
 #include "slm_dsts.h"
 #include "dslim_comm.h"
+#include "dslim_cache.h"
 #include "expeRT.h"
 
 /* Macros for SLM bitmask operations */
@@ -34,6 +35,95 @@
 
 #define NIBUFFS                            20
 
+/* iA entries per skip directory sample (one cache line) */
+#define SKIPSTRIDE                         16
+#define SKIPSIZE(x)                        (((x) + SKIPSTRIDE - 1) / SKIPSTRIDE)
+
+/* bA bins per coarse bucket in the SLM-Transform scatter */
+#define SCATTERBINS                        128u
+
+/* Mass buckets per Da in the precursor mass directory */
+#define MASSBKTS                           10
+#define MASSBUCKET(m)                      ((int_t)((m) * MASSBKTS))
+
+/* Scorecard entry accessors */
+static inline bool_t SC_Empty(const BYC &e) { return e.bc + e.yc == 0; }
+static inline uint_t SC_BCount(const BYC &e) { return e.bc; }
+static inline uint_t SC_YCount(const BYC &e) { return e.yc; }
+static inline uint_t SC_BIntn(const BYC &e) { return e.ibc; }
+static inline uint_t SC_YIntn(const BYC &e) { return e.iyc; }
+
+static inline void SC_Add(BYC &e, int_t isB, int_t isY, uint_t intn)
+{
+    e.bc += isB;
+    e.ibc += intn * isB;
+
+    e.yc += isY;
+    e.iyc += intn * isY;
+}
+
+static inline uint_t SC_Pack(uint_t w, uint_t intn)
+{
+    uint_t cnt = std::min((w >> SCINTBITS) + 1, SCCNTMAX);
+    uint_t sum = std::min((w & SCINTMASK) + ((intn + (1u << (SCISHIFT - 1))) >> SCISHIFT), SCINTMASK);
+
+    return (cnt << SCINTBITS) | sum;
+}
+
+static inline bool_t SC_Empty(const cBYC &e) { return (e.b | e.y) == 0; }
+static inline uint_t SC_BCount(const cBYC &e) { return e.b >> SCINTBITS; }
+static inline uint_t SC_YCount(const cBYC &e) { return e.y >> SCINTBITS; }
+static inline uint_t SC_BIntn(const cBYC &e) { return (e.b & SCINTMASK) << SCISHIFT; }
+static inline uint_t SC_YIntn(const cBYC &e) { return (e.y & SCINTMASK) << SCISHIFT; }
+
+static inline void SC_Add(cBYC &e, int_t isB, int_t isY, uint_t intn)
+{
+    if (isB)
+        e.b = SC_Pack(e.b, intn);
+
+    if (isY)
+        e.y = SC_Pack(e.y, intn);
+}
+
+/* Largest fragment tolerance (dF) with a dedicated query kernel */
+#define QKERNELDF                          4
+
+/* Candidates per tile of the vectorized hyperscore pass */
+#define HSTILE                             256
+
+/* Max queries per group in the chunk-major traversal */
+#define QGROUPSIZE                         16
+
+/* Work-stealing search runtime: spectra per task (to avoid
+ * false sharing), task deque capacity, steal passes before an
+ * idle worker parks and the task encoding
+ * [batch slot (8 bits) | first unit (28 bits) | last unit (28 bits)] */
+#define WSGRAIN                            4
+#define WSQSIZE                            256
+#define WSSPINS                            64
+#define WSUNITBITS                         28
+#define WSUNITMASK                         ((1ull << WSUNITBITS) - 1)
+#define WSTASK(slot,first,last)            (((ull_t)(slot) << (2 * WSUNITBITS)) |           \
+                                            ((ull_t)(first) << WSUNITBITS) | (ull_t)(last))
+#define WSSLOT(t)                          ((int_t)((t) >> (2 * WSUNITBITS)))
+#define WSFIRST(t)                         ((int_t)(((t) >> WSUNITBITS) & WSUNITMASK))
+#define WSLAST(t)                          ((int_t)((t) & WSUNITMASK))
+
+/* iA entry encoding: [peptide ID | isY (1 bit) | charge - 1 (IONCHGBITS)] */
+#define IONCHGBITS                         3
+#define IONSHIFT                           (IONCHGBITS + 1)
+#define IONCHGMASK                         ((1u << IONCHGBITS) - 1)
+#define ENCODEION(pep,isY,chg)             (((pep) << IONSHIFT) | ((isY) << IONCHGBITS) | (chg))
+#define IONPEPID(x)                        ((x) >> IONSHIFT)
+#define IONISY(x)                          (((x) >> IONCHGBITS) & 0x1)
+#define IONCHG(x)                          (((x) & IONCHGMASK) + 1)
+
+/* Encode the k'th fragment-ion of a chunk's SpecArr */
+#define ENCODESPECION(k,speclen,peplen_1,maxz)                                   \
+                                           ENCODEION((k) / (speclen),                \
+                                           ((k) % (speclen)) / ((speclen) / 2),      \
+                                           (((k) % (speclen)) / (peplen_1)) % (maxz))
+
 /* FUNCTION: DSLIM_Construct
  *
  * DESCRIPTION: Construct DSLIM chunks
@@ -92,19 +182,36 @@ status_t DSLIM_ConstructChunk(uint_t threads, Index *index, uint_t chunk_number)
 status_t DSLIM_SLMTransform(uint_t threads, Index *index, uint_t chunk_number);
 
 /*
- * FUNCTION: DSLIM_Optimize
+ * FUNCTION: DSLIM_SkipDirectory
  *
- * DESCRIPTION: Constructs SLIM Transform
+ * DESCRIPTION: Sample every SKIPSTRIDE'th iA entry into the
+ *              skip directory (sA) so that the bins can be
+ *              clipped without binary searching the iA
  *
  * INPUT:
- * @threads     : Number of parallel threads
  * @index       : The SLM Index
  * @chunk_number: Chunk Index
  *
  * OUTPUT:
  * @status: Status of execution
  */
-status_t DSLIM_Optimize(Index *index, uint_t chunk_number);
+status_t DSLIM_SkipDirectory(Index *index, uint_t chunk_number);
+
+/*
+ * FUNCTION: DSLIM_MassDirectory
+ *
+ * DESCRIPTION: Copy the precursor masses of the pepEntries
+ *              into a contiguous array, bucket them into
+ *              a direct-mapped directory of MASSBKTS per Da
+ *              and record the peptide range of each chunk
+ *
+ * INPUT:
+ * @index: The SLM Index
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t DSLIM_MassDirectory(Index *index);
 
 /*
  * FUNCTION: DSLIM_InitializeSC
@@ -179,22 +286,6 @@ status_t DSLIM_Destroy_Handles(Index *index);
 
 status_t DSLIM_MS2Initialize();
 
-/* FUNCTION: DSLIM_QuerySpectrum
- *
- * DESCRIPTION: Query the DSLIM for all query peaks
- *              and count the number of hits per chunk
- *
- * INPUT:
- * @QA     : Query Spectra Array
- * @len    : Number of spectra in the array
- * @Matches: Array to fill in the number of hits per chunk
- * @threads: Number of parallel threads to launch
- *
- * OUTPUT:
- * @status: Status of execution
- */
-status_t DSLIM_QuerySpectrum(Queries<int> *ss, Index *index, uint_t indexchunks, int);
-
 /* FUNCTION: DSLIM_WriteLIBSVM
  *
  * DESCRIPTION: Write the MS/MS spectra data in libsvm format
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019 Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include "slm_dsts.h"
+
+/* Index cache file extension, magic and format version */
+#define SLMIDX_EXT                         ".slmidx"
+#define SLMIDX_MAGIC                       "HCPSLMI"
+#define SLMIDX_VERSION                     3
+
+/* Alignment of each section in the index cache file */
+#define SLMIDX_ALIGN                       64
+
+/*
+ * Header of the index cache file. Records all parameters
+ * that shape the Index so that a stale file is never used.
+ * The header is followed by (each section SLMIDX_ALIGN aligned):
+ * pepEntries[lcltotCnt], pepIndex.seqs[AAs] and then
+ * bA[max_mass * scale + 1], iA[csize * speclen] (ENCODEION) and
+ * sA[SKIPSIZE(csize * speclen)] per chunk.
+ */
+struct slmIdxHeader
+{
+    char_t    magic[8];
+    uint_t    version;
+    uint_t    hdrsize;
+    uint_t    entrysize;
+
+    /* parameters that shape the index */
+    uint_t    peplen;
+    uint_t    maxz;
+    uint_t    scale;
+    uint_t    min_mass;
+    uint_t    max_mass;
+    uint_t    policy;
+    uint_t    nodes;
+    uint_t    myid;
+    uint_t    vmods_per_pep;
+    uint_t    num_vars;
+    uint_t    modMass[MAX_MOD_TYPES];
+    char_t    modconditions[256];
+
+    /* database (*.peps) file stamp */
+    ull_t     dbsize;
+    longlong_t dbmtime;
+
+    /* index shape */
+    uint_t    pepCount;
+    uint_t    modCount;
+    uint_t    totalCount;
+    uint_t    lclpepCnt;
+    uint_t    lclmodCnt;
+    uint_t    lcltotCnt;
+    uint_t    nChunks;
+    uint_t    chunksize;
+    uint_t    lastchunksize;
+    uint_t    AAs;
+
+    /* total size of the file in bytes */
+    ull_t     filesize;
+};
+
+/*
+ * FUNCTION: DSLIM_IndexCachePath
+ *
+ * DESCRIPTION: Path to the index cache file for a
+ *              peptide length at this node
+ *
+ * INPUT:
+ * @peplen: Peptide length
+ *
+ * OUTPUT:
+ * @path: Path to the index cache file
+ */
+string_t DSLIM_IndexCachePath(uint_t peplen);
+
+/*
+ * FUNCTION: DSLIM_LoadIndexCache
+ *
+ * DESCRIPTION: Memory map the index cache file (read-only)
+ *              into the Index if its header matches the
+ *              current parameters and database file.
+ *
+ * INPUT:
+ * @index : The SLM Index (pepIndex.peplen must be set)
+ * @dbfile: Path to the database (*.peps) file
+ *
+ * OUTPUT:
+ * @status: SLM_SUCCESS if loaded, error code otherwise
+ */
+status_t DSLIM_LoadIndexCache(Index *index, string_t &dbfile);
+
+/*
+ * FUNCTION: DSLIM_WriteIndexCache
+ *
+ * DESCRIPTION: Write a constructed Index to the index cache file
+ *
+ * INPUT:
+ * @index : The constructed SLM Index
+ * @dbfile: Path to the database (*.peps) file
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t DSLIM_WriteIndexCache(Index *index, string_t &dbfile);
+
+/*
+ * FUNCTION: DSLIM_UnmapIndexCache
+ *
+ * DESCRIPTION: Unmap the index cache file from the Index
+ *
+ * INPUT:
+ * @index : The SLM Index
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t DSLIM_UnmapIndexCache(Index *index);
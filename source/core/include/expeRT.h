@@ -87,12 +87,12 @@ private:
 
     /* Constructs a log-Weibull distribution */
     VOID logWeibullResponse(double_t, double_t, int_t ,int_t);
-    darray alogWeibullResponse(double_t, double_t, int_t, int_t);
 
-    /* Learning Function - Optimizing */
-    double_t logWeibullFit(lwvector<double_t> *, int_t, int_t, int_t niter=6000, double_t lr=0.12, double_t cutoff=1e-3);
+    /* Learning Function - Levenberg-Marquardt least squares */
+    double_t logWeibullFit(lwvector<double_t> *, int_t, int_t, int_t niter=100, double_t cutoff=1e-3);
 
-    inline double_t MeanSqError(const darray &);
+    /* Squared error of the log-Weibull response against y[s..e] */
+    double_t logWeibullError(const double_t *, int_t, int_t, double_t, double_t);
 
     template <class T>
     VOID LinearFit(T& x, T& y, int_t n, double_t &a, double_t &b);
@@ -107,7 +107,6 @@ private:
     static inline int_t largmax(T &data, int_t i1, int_t i2, double_t value);
 
     dvector vrange(int_t, int_t);
-    darray  arange(int_t, int_t);
 
 public:
 
@@ -27,6 +27,13 @@ using namespace std;
 
 #define DEF_SIZE                    20
 
+/*
+ * Double buffer of I/O buffers: the I/O threads take empty
+ * buffers from the waitQ and fill them into the readyQ; the
+ * search threads take them from the readyQ and return them
+ * to the waitQ. Both queues are lock-free, so none of the
+ * operations need the caller to hold a lock.
+ */
 template <class T>
 class lwbuff
 {
@@ -35,8 +42,6 @@ private:
     int_t cap;
     int_t thr_low;
     int_t thr_high;
-    sem_t lockr;
-    sem_t lockw;
 
     /* NOTE: The sizeof(readyQ) must be at least
      *       sizeof(workQ) + 1
@@ -54,9 +59,6 @@ public:
 
         readyQ = new lwqueue<T *>(DEF_SIZE, false);
         waitQ = new lwqueue<T *>(DEF_SIZE, false);
-
-        sem_init(&lockr, 0, 1);
-        sem_init(&lockw, 0, 1);
     }
 
     lwbuff(int_t dcap, int_t lo, int_t hi)
@@ -67,9 +69,6 @@ public:
 
         readyQ = new lwqueue<T*>(dcap, false);
         waitQ = new lwqueue<T*>(dcap, false);
-
-        sem_init(&lockr, 0, 1);
-        sem_init(&lockw, 0, 1);
     }
 
     ~lwbuff()
@@ -82,10 +81,6 @@ public:
 
         delete readyQ;
         delete waitQ;
-
-        sem_destroy(&lockr);
-        sem_destroy(&lockw);
-
     }
 
     VOID Add(T *item)
@@ -95,17 +90,17 @@ public:
 
     VOID vEmpty()
     {
+        T *ptr = NULL;
+
         /* Make sure both are empty */
-        for (int_t ii = 0; ii < readyQ->size(); ii ++)
-        {
-            readyQ->pop();
-            waitQ->pop();
-        }
+        while (readyQ->pop(ptr) == SLM_SUCCESS);
+        while (waitQ->pop(ptr) == SLM_SUCCESS);
     }
 
+    /* Publish a filled buffer and wake a waiting search thread */
     VOID IODone(T *ptr)
     {
-        readyQ->push(ptr);
+        readyQ->bpush(ptr);
     }
 
     VOID Replenish(T *ptr)
@@ -117,11 +112,7 @@ public:
     {
         T *rtn = NULL;
 
-        if (waitQ->size() > 0)
-        {
-            rtn = waitQ->front();
-            waitQ->pop();
-        }
+        waitQ->pop(rtn);
 
         return rtn;
     }
@@ -130,15 +121,34 @@ public:
     {
         T *rtn = NULL;
 
-        if (readyQ->size() > 0)
-        {
-            rtn = readyQ->front();
-            readyQ->pop();
-        }
+        readyQ->pop(rtn);
+
+        return rtn;
+    }
+
+    /* Sleep until a buffer is done with I/O and take it.
+     * Returns NULL once shutdown and drained */
+    T *waitWorkPtr()
+    {
+        T *rtn = NULL;
+
+        readyQ->bpop(rtn);
 
         return rtn;
     }
 
+    /* Wake all threads blocked in waitWorkPtr once drained */
+    VOID shutdown()
+    {
+        readyQ->close();
+    }
+
+    /* Total seconds spent blocked in waitWorkPtr */
+    double_t waitTime()
+    {
+        return readyQ->waitTime();
+    }
+
     T *releaseIOPtr(T *ptr)
     {
         T *rtn = NULL;
@@ -197,24 +207,4 @@ public:
         return ((idd+1) % cap);
     }
 
-    status_t lockr_()
-    {
-        return sem_wait(&lockr);
-    }
-
-    status_t unlockr_()
-    {
-        return sem_post(&lockr);
-    }
-
-    status_t lockw_()
-    {
-        return sem_wait(&lockw);
-    }
-
-    status_t unlockw_()
-    {
-        return sem_post(&lockw);
-    }
-
-};
\ No newline at end of file
+};
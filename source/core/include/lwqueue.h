@@ -21,6 +21,8 @@
 
 #include "common.hpp"
 #include <semaphore.h>
+#include <atomic>
+#include <chrono>
 
 using namespace std;
 
@@ -28,104 +30,92 @@ using namespace std;
 #define ISFULL                           -1
 #define ISEMPTY                          -2
 
+/* Cache line size to keep the ring positions apart */
+#define LWQ_LINE                          64
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue
+ * (Vyukov's ring). Each cell carries a sequence number that
+ * tells whether it is ready for the push or the pop at the
+ * position; threads claim positions with a CAS on tail/head.
+ * The BOOL sem constructor argument is kept for compatibility
+ * and ignored: every instance is thread-safe.
+ */
 template <class T>
 class lwqueue
 {
 private:
-    T     *arr;
-    int_t filled;
+
+    struct cell_t
+    {
+        std::atomic<ull_t> seq;
+        T                 data;
+    };
+
+    cell_t  *arr;
     int_t    cap;
-    int_t   head;
-    int_t   tail;
-    sem_t lock;
-    BOOL isSem;
 
-public:
+    /* Next push and pop positions */
+    alignas(LWQ_LINE) std::atomic<ull_t> tail;
+    alignas(LWQ_LINE) std::atomic<ull_t> head;
 
-    lwqueue()
-    {
-        cap = DEF_CAPACITY;
-        arr = new T[cap];
-        filled = 0;
-        head = 0;
-        tail = -1;
-        sem_init(&lock, 0, 1);
-        isSem = true;
-    }
+    /* Elements pushed by bpush and not yet taken by bpop.
+     * Also posted once by close to wake the waiters */
+    alignas(LWQ_LINE) sem_t items;
+    std::atomic<ull_t> waitns;
 
-    lwqueue(int_t dcap)
+    VOID init(int_t dcap)
     {
         cap = dcap;
+
         if (cap <= 0)
         {
             throw std::runtime_error("lwqueue initialized with zero capacity. Aborting");
         }
-        arr = new T[cap];
-        filled = 0;
-        head = 0;
-        tail = -1;
-        sem_init(&lock, 0, 1);
-        isSem = true;
+
+        arr = new cell_t[cap];
+
+        for (int_t i = 0; i < cap; i++)
+            arr[i].seq.store(i, std::memory_order_relaxed);
+
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+
+        sem_init(&items, 0, 0);
+        waitns.store(0, std::memory_order_relaxed);
     }
 
-    lwqueue(BOOL sem)
+public:
+
+    lwqueue()
     {
-        cap = DEF_CAPACITY;
-        arr = new T[cap];
-        filled = 0;
-        head = 0;
-        tail = -1;
+        init(DEF_CAPACITY);
+    }
 
-        if (sem == true)
-        {
-            sem_init(&lock, 0, 1);
-            isSem = true;
-        }
-        else
-        {
-            isSem = false;
-        }
+    lwqueue(int_t dcap)
+    {
+        init(dcap);
     }
 
-    lwqueue(int_t dcap, BOOL sem)
+    lwqueue(BOOL)
     {
-        cap = dcap;
-        if (cap <= 0)
-        {
-            throw std::runtime_error("lwqueue initialized with zero capacity. Aborting");
-        }
-        arr = new T[cap];
-        filled = 0;
-        head = 0;
-        tail = -1;
-        if (sem)
-        {
-            sem_init(&lock, 0, 1);
-            isSem = true;
-        }
-        else
-        {
-            isSem = false;
-        }
+        init(DEF_CAPACITY);
     }
 
-    lwqueue(T *ar, int_t sz, BOOL sem)
+    lwqueue(int_t dcap, BOOL)
     {
-        cap = sz;
-        arr = ar;
-        filled = sz;
-        head = 0;
-        tail = sz - 1;
+        init(dcap);
+    }
 
-        if (sem)
-        {
-            sem_init(&lock, 0, 1);
-            isSem = true;
-        }
-        else
-        {
-            isSem = false;
-        }
+    /* Takes over a full array */
+    lwqueue(T *ar, int_t sz, BOOL)
+    {
+        init(sz);
+
+        for (int_t i = 0; i < sz; i++)
+            push(ar[i]);
+
+        delete[] ar;
     }
 
     ~lwqueue()
@@ -133,156 +123,169 @@ public:
         delete[] arr;
         arr = NULL;
         cap = 0;
-        filled = 0;
-        head = 0;
-        tail = -1;
 
-        if (isSem)
-        {
-            sem_destroy(&lock);
-            isSem = false;
-        }
-    }
-
-    inline int_t plusOne(int_t idx)
-    {
-        return ((idx + 1) % cap);
-    }
-
-    inline int_t minusOne(int_t idx)
-    {
-        return ((idx - 1) % cap);
+        sem_destroy(&items);
     }
 
     status_t push(T elmnt)
     {
-        status_t status = SLM_SUCCESS;
-
-        if (isSem)
-            sem_wait (&lock);
+        ull_t pos = tail.load(std::memory_order_relaxed);
 
-        if (filled < cap)
+        for (;;)
         {
-            tail = plusOne(tail);
-            arr[tail] = elmnt;
-            filled++;
-            status = SLM_SUCCESS;
+            cell_t &cell = arr[pos % cap];
+            longlong_t dif = (longlong_t)(cell.seq.load(std::memory_order_acquire) - pos);
+
+            /* The cell is free at pos: claim it */
+            if (dif == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.data = elmnt;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+
+                    return SLM_SUCCESS;
+                }
+            }
+            /* The cell still holds the element from a lap ago */
+            else if (dif < 0)
+                return ISFULL;
+            /* Another producer claimed pos */
+            else
+                pos = tail.load(std::memory_order_relaxed);
         }
-        else
-        {
-            status = ISFULL;
-        }
-
-        if (isSem)
-            sem_post (&lock);
-
-        return status;
     }
 
-    status_t pop()
+    status_t pop(T &elmnt)
     {
-        status_t status;
+        ull_t pos = head.load(std::memory_order_relaxed);
 
-        if (isSem)
-            sem_wait (&lock);
-
-        if (filled > 0)
-        {
-            head = plusOne(head);
-            filled--;
-            status = SLM_SUCCESS;
-        }
-        else
+        for (;;)
         {
-            status = ISEMPTY;
+            cell_t &cell = arr[pos % cap];
+            longlong_t dif = (longlong_t)(cell.seq.load(std::memory_order_acquire) - (pos + 1));
+
+            /* The cell is filled at pos: claim it */
+            if (dif == 0)
+            {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    elmnt = cell.data;
+                    cell.seq.store(pos + cap, std::memory_order_release);
+
+                    return SLM_SUCCESS;
+                }
+            }
+            /* Nothing pushed at pos yet */
+            else if (dif < 0)
+                return ISEMPTY;
+            /* Another consumer claimed pos */
+            else
+                pos = head.load(std::memory_order_relaxed);
         }
+    }
 
-        if (isSem)
-            sem_post (&lock);
+    status_t pop()
+    {
+        T elmnt;
 
-        return status;
+        return pop(elmnt);
     }
 
     BOOL isEmpty()
     {
-        BOOL res = false;
+        return size() == 0;
+    }
 
-        if (isSem)
-            sem_wait (&lock);
+    BOOL isFull()
+    {
+        return size() >= cap;
+    }
 
-        res = (filled == 0);
+    /* Peek at the first element. Only stable while
+     * no other thread pops from the queue */
+    T front()
+    {
+        ull_t pos = head.load(std::memory_order_acquire);
+        cell_t &cell = arr[pos % cap];
 
-        if (isSem)
-            sem_post (&lock);
+        if (cell.seq.load(std::memory_order_acquire) == pos + 1)
+            return cell.data;
 
-        return res;
+        return 0;
     }
 
-    BOOL isFull()
+    /* Peek at the last element. Only stable while
+     * no other thread pushes to the queue */
+    T end()
     {
-        BOOL res = false;
+        ull_t pos = tail.load(std::memory_order_acquire);
 
-        if (isSem)
-            sem_wait (&lock);
+        if (pos == head.load(std::memory_order_acquire))
+            return 0;
 
-        res = (filled == cap);
+        cell_t &cell = arr[(pos - 1) % cap];
 
-        if (isSem)
-            sem_post (&lock);
+        if (cell.seq.load(std::memory_order_acquire) == pos)
+            return cell.data;
 
-        return res;
+        return 0;
     }
 
-    T front()
+    /* Push and wake a thread blocked in bpop */
+    status_t bpush(T elmnt)
     {
-        T res;
-
-        if (isSem)
-            sem_wait (&lock);
+        status_t status = push(elmnt);
 
-        if (filled > 0)
-            res = arr[head];
-        else
-            res = 0;
+        if (status == SLM_SUCCESS)
+            sem_post(&items);
 
-        if (isSem)
-            sem_post (&lock);
-
-        return res;
+        return status;
     }
 
-    T end()
+    /* Sleep until an element is pushed by bpush and pop it.
+     * Returns ISEMPTY once the queue is closed and drained */
+    status_t bpop(T &elmnt)
     {
-        T res;
+        status_t status = SLM_SUCCESS;
 
-        if (isSem)
-            sem_wait (&lock);
+        if (sem_trywait(&items))
+        {
+            auto start = std::chrono::steady_clock::now();
 
-        if (filled > 0)
-            res = arr[tail];
-        else
-            res = 0;
+            while (sem_wait(&items) && errno == EINTR);
 
-        if (isSem)
-            sem_post (&lock);
+            waitns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
 
-        return res;
+        status = pop(elmnt);
+
+        /* Closed: pass the wakeup on to the next waiter */
+        if (status == ISEMPTY)
+            sem_post(&items);
+
+        return status;
     }
 
-    int_t size()
+    /* Wake all threads blocked in bpop once drained */
+    VOID close()
     {
-        int_t res = 0;
-
-        if (isSem)
-            sem_wait (&lock);
+        sem_post(&items);
+    }
 
-        res = filled;
+    /* Total seconds spent blocked in bpop */
+    double_t waitTime()
+    {
+        return waitns.load() * 1e-9;
+    }
 
-        if (isSem)
-            sem_post (&lock);
+    /* Number of elements, exact when the queue is quiescent */
+    int_t size()
+    {
+        ull_t t = tail.load(std::memory_order_acquire);
+        ull_t h = head.load(std::memory_order_acquire);
 
-        return res;
+        return (t > h) ? (int_t) (t - h) : 0;
     }
 
-
-};
\ No newline at end of file
+};
@@ -27,7 +27,9 @@
 #define ERROR_POSITION_LESS_THAN_0 -1
 #define ERROR_HEAP_FULL capacity
 
-/* Main class */
+/* Main class: bounded min heap keeping the top-K (largest) elements.
+ * Ties keep the element inserted first: an equal element neither
+ * becomes the max nor evicts the min */
 template<class T>
 class minHeap //the main min heap class
 {
@@ -36,7 +38,11 @@ private:
     int capacity;
     T* array;
 
+    /* Largest element inserted since the last reset */
+    T maxe;
+
     int heapify(int element_position);
+    void siftup(int element_position);
     void swap(T&, T&);
     void swap(int, int);
 
@@ -80,7 +86,8 @@ public:
 template<class T>
 int minHeap<T>::init(int capacity)
 {
-    this->capacity = capacity;
+    /* At least one element must be kept */
+    this->capacity = (capacity < 1) ? 1 : capacity;
     this->size = 0;
     this->array = new T[this->capacity];
 
@@ -90,29 +97,30 @@ int minHeap<T>::init(int capacity)
 template<class T>
 int minHeap<T>::reset()
 {
+    /* Stale elements are overwritten by insert */
     this->size = 0;
-    for (int i = 0; i < this->capacity; i++)
-    {
-        T fresh;
-        array[i] = fresh;
-    }
+
     return 0;
 }
 
 template<class T>
 int minHeap<T>::insert(T &element)
 {
+    /* Track the max in O(1) */
+    if (size == 0 || element > maxe)
+        maxe = element;
+
     if (size == capacity)
     {
+        /* Early reject anything that does not beat the current min */
+        if (!(element > array[0]))
+            return ERROR_HEAP_FULL;
+
         return increase_key(0, element);
     }
 
-    array[size++] = element;
-
-    for (int i = (size - 1) / 2; i >= 0; i--)
-    {
-        heapify(i);
-    }
+    array[size] = element;
+    siftup(size++);
 
     return 0;
 }
@@ -134,39 +142,57 @@ void minHeap<T>::swap(T& t1, T& t2)
 template<class T>
 void minHeap<T>::swap(int p1, int p2)
 {
-    T&& temp  = array[p1];
+    T temp    = array[p1];
     array[p1] = array[p2];
     array[p2] = temp;
 }
 
 template<class T>
-int minHeap<T>::heapify(int element_position)
+void minHeap<T>::siftup(int element_position)
 {
-    int rchild_pos = (element_position + 1) * 2;
-    int lchild_pos = rchild_pos - 1;
+    T element = array[element_position];
 
-    int smallest_element_position = element_position;
+    while (element_position > 0)
+    {
+        int parent_position = (element_position - 1) >> 1;
 
-    T smallest_element = array[smallest_element_position];
+        if (!(element < array[parent_position]))
+            break;
 
-    if (lchild_pos < size && array[lchild_pos] < smallest_element)
-    {
-        smallest_element_position = lchild_pos;
-        smallest_element          = array[lchild_pos];
+        array[element_position] = array[parent_position];
+        element_position = parent_position;
     }
 
-    if (rchild_pos < size && array[rchild_pos] < smallest_element)
-    {
-        smallest_element_position = rchild_pos;
-        smallest_element          = array[rchild_pos];
-    }
+    array[element_position] = element;
+}
+
+template<class T>
+int minHeap<T>::heapify(int element_position)
+{
+    T element = array[element_position];
 
-    if (smallest_element_position != element_position)
+    for (;;)
     {
-        swap(array[smallest_element_position], array[element_position]);
-        heapify(smallest_element_position);
+        int lchild_pos = (element_position * 2) + 1;
+
+        if (lchild_pos >= size)
+            break;
+
+        int rchild_pos = lchild_pos + 1;
+        int smallest_child_position = lchild_pos;
+
+        if (rchild_pos < size && array[rchild_pos] < array[lchild_pos])
+            smallest_child_position = rchild_pos;
+
+        if (!(array[smallest_child_position] < element))
+            break;
+
+        array[element_position] = array[smallest_child_position];
+        element_position = smallest_child_position;
     }
 
+    array[element_position] = element;
+
     return 0;
 }
 
@@ -195,14 +221,8 @@ int minHeap<T>::decrease_key(int element_position, T new_value)
 
     array[element_position] = new_value;
 
-    int parent_position = (element_position + 1 >> 1) - 1;
+    siftup(element_position);
 
-    while ((array[parent_position] > array[element_position]) && (parent_position >= 0))
-    {
-        swap(array[parent_position], array[element_position]);
-        element_position = parent_position;
-        parent_position = (parent_position - 1) >> 1;
-    }
     return 0;
 }
 
@@ -236,6 +256,7 @@ int minHeap<T>::heap_sort(T *output_array)
         output_array[i] = extract_min();
     }
 
+    return 0;
 }
 
 template<class T>
@@ -243,7 +264,8 @@ T minHeap<T>::show_element(int element_position)
 {
     if (element_position > size - 1)
     {
-        return ERROR_POSITION_GREATER_THAN_HEAP_SIZE;
+        T fresh;
+        return fresh;
     }
 
     return array[element_position];
@@ -252,21 +274,11 @@ T minHeap<T>::show_element(int element_position)
 template<class T>
 T minHeap<T>::getMax()
 {
-    if (size <= 1)
-    {
-        return array[0];
-    }
-
-    T maxe = array[size - 1];
-
-    // the limit here was k > 0 instead of size/2
-    for (int_t k = size-2; k >= size/2; k --)
+    if (size < 1)
     {
-        if (array[k] > maxe)
-        {
-            maxe = array[k];
-        }
+        T fresh;
+        return fresh;
     }
 
     return maxe;
-}
\ No newline at end of file
+}
@@ -102,6 +102,45 @@ struct _info
 using info_t = _info;
 using spectrum_t = _Spectrum<spectype_t>;
 
+/* Preprocessed spectra (.pbin) file magic and format version */
+#define PBIN_MAGIC                         "HCPPBIN"
+#define PBIN_VERSION                       3
+
+/*
+ * Header of the .pbin file. Records the preprocessing parameters
+ * and the source MS2 file stamp so that a stale file is detected.
+ * The header is followed by batches of QCHUNK spectra, each stored
+ * columnar as: npeaks (ull_t), prec_mz[n], z[n], rtimes[n], idx[n+1],
+ * mzs[npeaks], intns[npeaks] and padded to 8 bytes, i.e. in the
+ * layout of Queries so that a batch can be searched in place.
+ * The file ends with an offset table of nbatches (ull_t) batch
+ * offsets starting at tableoff.
+ */
+struct pbinHeader
+{
+    char_t    magic[8];
+    uint_t    version;
+    uint_t    hdrsize;
+
+    /* preprocessing parameters */
+    uint_t    spectsize;
+    uint_t    scale;
+    uint_t    qalen;
+    uint_t    qchunk;
+    uint_t    yaxis;
+    int_t     base_int;
+    int_t     min_int;
+
+    /* source (*.ms2) file stamp */
+    ull_t     ms2size;
+    longlong_t ms2mtime;
+
+    /* contents */
+    uint_t    count;
+    uint_t    nbatches;
+    ull_t     tableoff;
+};
+
 class MSQuery
 {
 protected:
@@ -110,8 +149,16 @@ protected:
     uint_t running_count;
     uint_t curr_chunk;
     info_t info;
-    std::ifstream *qfile;
     uint_t qfileIndex;
+
+    /* Memory-mapped MS2 (or .pbin) file and offset of the next scan */
+    const char_t *ms2addr;
+    size_t ms2size;
+    size_t ms2off;
+
+    /* Shared with the Queries viewing the .pbin batches */
+    std::shared_ptr<const char_t> pbinmap;
+
     string_t MS2file;
     spectrum_t spectrum;
     bool_t m_isinit;
@@ -120,6 +167,7 @@ protected:
     static std::array<int, 2> readMS2file(string_t *filename);
 
     void readMS2spectrum();
+    void unmap();
     
     template <typename T>
     void readBINbatch(int, int, Queries<T> *);
@@ -158,6 +206,8 @@ public:
 
     bool_t isinit();
 
+    static bool verifyBinaryFile(const string_t &);
+
     static void flushBinaryFile(string_t *filename, spectype_t *m_mzs, spectype_t *m_intns, float *rtimes, float *prec_mz, int *z, int *lens, int count, bool close = false);
 
 };
@@ -22,6 +22,7 @@
 #include "common.hpp"
 #include <vector>
 #include <thread>
+#include <atomic>
 
 class Scheduler
 {
@@ -31,8 +32,13 @@ private:
     int_t nIOThds;
     int_t maxIOThds;
 
+    /* maxIOThds I/O workers, parked until dispatched */
     std::vector<std::thread> thread_pool;
 
+    /* Posted once per dispatch to unpark a worker */
+    lock_t wakeup;
+    std::atomic<bool_t> poolexit;
+
     /* Lock for above queues */
     lock_t manage;
 
@@ -62,6 +68,8 @@ private:
 
 
     /* Private Functions */
+    VOID     startPool();
+    VOID     ioWorker();
     double_t forecastLASP(double_t yt);
     double_t forecastLASP(double_t yt, double_t deltaS);
     BOOL   makeDecisions(double_t yt, int_t decisions);
@@ -72,6 +80,7 @@ public:
     ~Scheduler();
 
     status_t dispatchThread();
+    status_t dispatchIdle();
     int_t    getNumActivThds();
     BOOL   checkPreempt();
     status_t takeControl();
@@ -23,6 +23,9 @@
 #include "config.hpp"
 #include "minheap.h"
 #include <cstring>
+#include <memory>
+#include <atomic>
+#include <chrono>
 
 /* Types of modifications allowed by SLM_Mods     */
 #define MAX_MOD_TYPES                        15
@@ -295,15 +298,62 @@ struct BYC
     uint_t      iyc; // y ion intensities
 };
 
+/* Compact scorecard entry: the ion count (SCCNTBITS) and the
+ * intensity sum in units of 2^SCISHIFT (SCINTBITS, saturating)
+ * of each ion series packed into a word */
+#define SCCNTBITS                          8
+#define SCINTBITS                          24
+#define SCCNTMAX                           ((1u << SCCNTBITS) - 1)
+#define SCINTMASK                          ((1u << SCINTBITS) - 1)
+#define SCISHIFT                           4
+
+struct cBYC
+{
+    uint_t        b; // b ion count | b ion intensities
+    uint_t        y; // y ion count | y ion intensities
+};
+
+/* The CPU scorecard entry */
+#if defined (COMPACT_SC)
+using scEntry = cBYC;
+#else
+using scEntry = BYC;
+#endif /* COMPACT_SC */
+
+/* Blocked scatter of the fragment-ion hits into the scorecard:
+ * windows of >= SCATTERWIN candidates are scattered SCATTERWIN
+ * candidates at a time, buffering the hits per block of SCBLOCK
+ * scorecard entries and applying them a block at a time */
+#define SCBLOCKSHIFT                       11
+#define SCBLOCK                            (1u << SCBLOCKSHIFT)
+#define SCBLOCKS(x)                        (((x) + SCBLOCK - 1) >> SCBLOCKSHIFT)
+#define SCHITS                             256
+#define SCATTERWIN                         (1u << 20)
+
+/* A fragment-ion hit buffered for the blocked scatter */
+struct BYHit
+{
+    uint_t      key; // chunk-local peptide ID << 1 | isY
+    uint_t     intn; // intensity of the matched peak
+};
+
 struct DSLIM_Matrix
 {
     uint_t    *iA; // Ions Array (iA)
     uint_t    *bA; // Bucket Array (bA)
+    uint_t    *sA; // Skip directory (every SKIPSTRIDE'th iA entry)
+
+    uint_t    pepoffset; // First pepEntry of the chunk
+    uint_t    npeps;     // Number of peptides in the chunk
 
     DSLIM_Matrix()
     {
         iA = NULL;
         bA = NULL;
+        sA = NULL;
+
+        pepoffset = 0;
+        npeps = 0;
     }
 };
 
@@ -327,6 +377,15 @@ typedef struct _Index
     pepEntry *pepEntries;
     spmat_t    *ionIndex;
 
+    float_t    *pepMass;  // precursor masses of pepEntries
+    uint_t     *massDir;  // first pepEntry of each mass bucket
+    uint_t      nmassDir;
+    float_t     minMass;  // precursor mass range of the index
+    float_t     maxMass;
+
+    void       *mmapaddr; // index cache mapping (if loaded from file)
+    size_t      mmapsize;
+
     _Index()
     {
         pepCount = 0;
@@ -342,6 +401,15 @@ typedef struct _Index
 
         pepEntries = NULL;
         ionIndex = NULL;
+
+        pepMass = NULL;
+        massDir = NULL;
+        nmassDir = 0;
+        minMass = 0;
+        maxMass = 0;
+
+        mmapaddr = NULL;
+        mmapsize = 0;
     }
 } Index;
 
@@ -365,6 +433,8 @@ enum FileType_t {
     uint_t scale;
     uint_t min_shp;
     uint_t min_cpsm;
+    uint_t prefilter;
+    uint_t pfkeep;
     uint_t nodes;
     uint_t myid;
     uint_t spadmem;
@@ -379,6 +449,9 @@ enum FileType_t {
     bool_t useGPU;
     bool_t reindex;
     bool_t nocache;
+    bool_t nodbcache;
+    bool_t chunkmajor;
+    bool_t matchz;
     bool_t gpuindex;
 
     double_t dM;
@@ -411,11 +484,20 @@ enum FileType_t {
         expect_max = 20;
         min_shp = 4;
         min_cpsm = 4;
+        prefilter = 0;
+        pfkeep = 64;
         base_int = 1000000;
         min_int = 0.01 * base_int;
         useGPU = false;
         reindex = true;
         nocache = false;
+        nodbcache = false;
+        chunkmajor = false;
+#ifdef MATCH_CHARGE
+        matchz = true;
+#else
+        matchz = false;
+#endif /* MATCH_CHARGE */
         gpuindex = true;
         nodes = 1;
         myid = 0;
@@ -479,10 +561,15 @@ enum FileType_t {
         printVar(expect_max);
         printVar(min_shp);
         printVar(min_cpsm);
+        printVar(prefilter);
+        printVar(pfkeep);
         printVar(base_int);
         printVar(useGPU);
         printVar(reindex);
         printVar(nocache);
+        printVar(nodbcache);
+        printVar(chunkmajor);
+        printVar(matchz);
         printVar(gpuindex);
         printVar(min_int);
         printVar(nodes);
@@ -531,6 +618,10 @@ struct Queries
     int_t     batchNum;
     int_t      fileNum;
 
+    /* Read-only mapped file the arrays point into (view mode).
+     * Null if the arrays are owned (allocated by init) */
+    std::shared_ptr<const char_t> mapping;
+
     void reset()
     {
         fileNum  = 0;
@@ -547,6 +638,7 @@ struct Queries
         this->moz       = NULL;
         this->charges   = NULL;
         this->intensity = NULL;
+        this->rtimes    = NULL;
         numPeaks        = 0;
         numSpecs        = 0;
         batchNum        = 0;
@@ -554,6 +646,8 @@ struct Queries
 
     VOID init(int chunksize = QCHUNK)
     {
+        release();
+
         this->idx       = new uint_t[chunksize + 1];
         this->precurse  = new float_t[chunksize];
         this->charges   = new int_t[chunksize];
@@ -566,6 +660,30 @@ struct Queries
         batchNum        = 0;
     }
 
+    /*
+     * Point the arrays at a batch of spectra stored in a mapped
+     * file instead of copying them. The mapping is kept alive
+     * until the next init, view or deinit and must not be written
+     */
+    VOID view(const std::shared_ptr<const char_t> &map, const uint_t *idx, const float_t *precurse,
+              const int_t *charges, const float_t *rtimes, const T *moz, const T *intensity,
+              int_t numSpecs, int_t numPeaks)
+    {
+        release();
+
+        this->mapping   = map;
+        this->idx       = const_cast<uint_t *>(idx);
+        this->precurse  = const_cast<float_t *>(precurse);
+        this->charges   = const_cast<int_t *>(charges);
+        this->rtimes    = const_cast<float_t *>(rtimes);
+        this->moz       = const_cast<T *>(moz);
+        this->intensity = const_cast<T *>(intensity);
+        this->numSpecs  = numSpecs;
+        this->numPeaks  = numPeaks;
+    }
+
+    bool_t isView() { return mapping != nullptr; }
+
     VOID deinit()
     {
         fileNum  = -1;
@@ -574,41 +692,7 @@ struct Queries
         batchNum = -1;
 
         /* Deallocate the memory */
-        if (this->moz != NULL)
-        {
-            delete[] this->moz;
-            this->moz = NULL;
-        }
-
-        if (this->intensity != NULL)
-        {
-            delete[] this->intensity;
-            this->intensity = NULL;
-        }
-
-        if (this->precurse != NULL)
-        {
-            delete[] this->precurse;
-            this->precurse = NULL;
-        }
-
-        if (this->charges != NULL)
-        {
-            delete[] this->charges;
-            this->charges = NULL;
-        }
-
-        if (this->rtimes != NULL)
-        {
-            delete[] this->rtimes;
-            this->rtimes = NULL;
-        }
-
-        if (this->idx != NULL)
-        {
-            delete[] this->idx;
-            this->idx = NULL;
-        }
+        release();
     }
 
     ~Queries()
@@ -618,6 +702,28 @@ struct Queries
         batchNum = 0;
 
         /* Deallocate the memory */
+        release();
+    }
+
+private:
+
+    /* Free the owned arrays or drop the mapping */
+    VOID release()
+    {
+        if (mapping != nullptr)
+        {
+            mapping.reset();
+
+            this->moz       = NULL;
+            this->intensity = NULL;
+            this->precurse  = NULL;
+            this->charges   = NULL;
+            this->rtimes    = NULL;
+            this->idx       = NULL;
+
+            return;
+        }
+
         if (this->moz != NULL)
         {
             delete[] this->moz;
@@ -660,26 +766,25 @@ struct Queries
 /* Score entry that goes into the heap */
 typedef struct _heapEntry
 {
+    /* Computed hyperscore */
+    float_t hyperscore;
+
+    /* Parent spectrum ID in the respective chunk of index */
+    int_t        psid;
+
     /* The index * + offset */
     ushort_t    idxoffset;
 
     /* Number of shared ions in the spectra */
     ushort_t   sharedions;
 
-    /* Total ions in spectrum */
-    ushort_t    totalions;
-
+    /* Query spectrum information (only filled
+     * in for the extracted top PSM) */
     ushort_t    fileIndex;
-
-    /* Parent spectrum ID in the respective chunk of index */
-    int_t        psid;
+    short_t      pchg;
     float_t     pmass;
-    int_t        pchg;
     float_t     rtime;
 
-    /* Computed hyperscore */
-    float_t hyperscore;
-
     /* Constructor */
     _heapEntry()
     {
@@ -688,35 +793,11 @@ typedef struct _heapEntry
         psid       = 0;
         hyperscore = 0;
         sharedions = 0;
-        totalions  = 0;
         pmass      = 0;
         pchg       = 0;
         rtime      = 0;
     }
 
-    /* Copy constructor */
-    _heapEntry(const _heapEntry &obj)
-    {
-        memcpy(this, &obj, sizeof(_heapEntry));
-
-        /*idxoffset  = obj.idxoffset;
-        psid       = obj.psid;
-        hyperscore = obj.hyperscore;
-        sharedions = obj.sharedions;
-        totalions  = obj.totalions;
-        pmass      = obj.pmass;*/
-    }
-
-    /* Overload = operator */
-    _heapEntry& operator=(const _heapEntry& rhs)
-    {
-        /* Check for self assignment */
-        if (this != &rhs)
-            memcpy(this, &rhs, sizeof(_heapEntry));
-
-        return *this;
-    }
-
     /* Overload = operator */
     _heapEntry& operator=(const int_t& rhs)
     {
@@ -725,7 +806,6 @@ typedef struct _heapEntry
         this->fileIndex = rhs;
         this->hyperscore = rhs;
         this->sharedions = rhs;
-        this->totalions = rhs;
         this->pmass = rhs;
         this->pchg = rhs;
         this->rtime = rhs;
@@ -954,17 +1034,46 @@ typedef struct _partResult
 
 typedef struct _BYICount
 {
-    BYC     *byc;       /* Both counts */
+    scEntry *byc;       /* Both counts */
+    uint_t  *touched;   /* IDs of the byc entries hit by the current query */
+    uint_t   ntouched;  /* Number of entries hit (may exceed mtouched) */
+    uint_t   mtouched;  /* Capacity of touched */
     Results  res;
+    Results *gres;      /* Results of a query group (chunk-major mode) */
+    BYHit   *hits;      /* SCHITS hits buffered per block of a SCATTERWIN window */
+    uint_t  *nhits;     /* Number of hits in each block buffer */
+    Results *pres;      /* Prefilter shortlists (two-stage search) */
+    hCell   *pcells;    /* Shortlist being rescored (two-stage search) */
+    uint_t  *spec;      /* Regenerated theoretical spectrum (two-stage search) */
+    float_t *ladder;    /* Ion ladder scratch of UTILS_GenerateSpectrum */
 
     _BYICount()
     {
         byc = NULL;
+        touched = NULL;
+        ntouched = 0;
+        mtouched = 0;
+        gres = NULL;
+        hits = NULL;
+        nhits = NULL;
+        pres = NULL;
+        pcells = NULL;
+        spec = NULL;
+        ladder = NULL;
     }
 
 } BYICount;
 
-#define BYISIZE                 (sizeof(BYC))
+/* Scan the scorecard sparsely if touched * SPARSESC < precursor window.
+ * The touched list only has to hold the entries of a sparse window */
+#define SPARSESC                           8
+#define SCTOUCHED(x)                       ((x) / SPARSESC + 1)
+
+/* Scorecard bytes per candidate, rounded up: the entry and its share
+ * of the touched list and of the hit buffers, which are allocated
+ * for one SCATTERWIN window only if the chunks are that large */
+#define BYISIZE                 ((sizeof(scEntry) * SCBLOCK + sizeof(uint_t) * (SCBLOCK / SPARSESC) +  \
+                                  (sizeof(BYHit) * SCHITS + sizeof(uint_t)) + SCBLOCK - 1) / SCBLOCK)
 
 typedef struct _fResult
 {
@@ -1047,6 +1156,42 @@ typedef struct _ebuffer
 
 } ebuffer;
 
+/* A batch of queries in flight in the search runtime */
+typedef struct _qbatch
+{
+    Queries<spectype_t> *ss;
+    int_t bid;
+    int_t specID;
+
+    /* Search units: spectra or (chunk-major) query groups */
+    int_t nunits;
+    std::vector<int_t> order;
+    std::vector<int_t> groups;
+
+    /* Partial results in the distributed memory mode */
+    ebuffer *liBuff;
+    partRes *txArray;
+
+    /* Units not searched yet */
+    std::atomic<int_t> left;
+    std::atomic<bool_t> busy;
+
+    std::chrono::system_clock::time_point start;
+
+    _qbatch()
+    {
+        ss = nullptr;
+        bid = -1;
+        specID = 0;
+        nunits = 0;
+        liBuff = nullptr;
+        txArray = nullptr;
+        left = 0;
+        busy = false;
+    }
+
+} qbatch_t;
+
 struct dIndex
 {
     int nChunks = 0;
@@ -88,6 +88,19 @@ void   UTILS_ParallelSort(Num *data, uint_t size, bool descending = false)
  */
 uint_t   UTILS_GetNumProcs();
 
+/*
+ * FUNCTION: UTILS_DispatchISA
+ *
+ * DESCRIPTION: Get the instruction set of the CPU_KERNEL
+ *              clones selected for this CPU at load time
+ *
+ * INPUT: none
+ *
+ * OUTPUT:
+ * @isa: Name of the selected instruction set
+ */
+const char *UTILS_DispatchISA();
+
 /*
  * FUNCTION: UTILS_Factorial
  *
@@ -169,6 +182,52 @@ struct Comb {
     ull_t val[N][N];
 };
 
+//
+// branch-free log10(1 + x) that vectorizes in simd loops.
+// The exponent is offset so that the mantissa m lands in
+// [sqrt(2)/2, sqrt(2)) and log(m) is the atanh series of
+// f = (m-1)/(m+1) up to f^19, i.e. within 1 ulp of libm
+//
+#ifdef USE_OMP
+#pragma omp declare simd notinbranch
+#endif /* USE_OMP */
+static inline double log10p1(double x)
+{
+    const ull_t sqrthalf = 0x3FE6A09E667F3BCDull;
+
+    double v = 1.0 + x;
+    ull_t u;
+    std::memcpy(&u, &v, sizeof(u));
+
+    u += 0x3FF0000000000000ull - sqrthalf;
+
+    /* Unbiased exponent as double via the 2^52 magic number */
+    ull_t eb = (u >> 52) | 0x4330000000000000ull;
+    double e;
+    std::memcpy(&e, &eb, sizeof(e));
+    e -= 4503599627370496.0 + 1023.0;
+
+    u = (u & 0x000FFFFFFFFFFFFFull) + sqrthalf;
+    double m;
+    std::memcpy(&m, &u, sizeof(m));
+
+    double f = (m - 1.0) / (m + 1.0);
+    double s = f * f;
+
+    double p = 1.0 / 19;
+    p = p * s + 1.0 / 17;
+    p = p * s + 1.0 / 15;
+    p = p * s + 1.0 / 13;
+    p = p * s + 1.0 / 11;
+    p = p * s + 1.0 / 9;
+    p = p * s + 1.0 / 7;
+    p = p * s + 1.0 / 5;
+    p = p * s + 1.0 / 3;
+    p = p * s + 1.0;
+
+    return (e * 0.6931471805599453 + 2.0 * f * p) * 0.4342944819032518;
+}
+
 } // namespace utils
 } // namespace hcp
 
@@ -205,17 +264,20 @@ status_t UTILS_ShuffleI(uint_t *, uint_t, ull_t);
 /*
  * FUNCTION: UTILS_GenerateSpectrum
  *
- * DESCRIPTION: Generates theoretical spectrum of a peptide
+ * DESCRIPTION: Generates theoretical spectrum of a (modified)
+ *              peptide without allocating any memory
  *
  * INPUT:
  * @seq     : Peptide sequence
  * @len     : Length of peptide
  * @Spectrum: Pointer to the theoretical spectrum
+ * @modInfo : Modified peptide information (modNum = 0 if none)
+ * @ladder  : Scratch space for iSERIES * maxz ions
  *
  * OUTPUT:
  * @mass: Precursor mass of peptide
  */
-float_t  UTILS_GenerateSpectrum(char_t *, uint_t, uint_t *);
+float_t  UTILS_GenerateSpectrum(AA *, uint_t, uint_t *, modAA &, float_t *);
 
 /*
  * FUNCTION: UTILS_CalculatePepMass
@@ -273,19 +335,3 @@ status_t UTILS_SetParams(gParams *params);
  * @mass: Precursor mass of modified peptide
  */
 float_t UTILS_CalculateModMass(AA *, uint_t, uint_t);
-
-/*
- * FUNCTION: UTILS_GenerateModSpectrum
- *
- * DESCRIPTION: Generates theoretical spectrum for a mod
- *
- * INPUT:
- * @seq     : Modified peptide sequence
- * @len     : Length of modified peptide
- * @Spectrum: Pointer to the theoretical spectrum
- * @modInfo : Modified peptide information
- *
- * OUTPUT:
- * @mass: Precursor mass of modified peptide
- */
-float_t UTILS_GenerateModSpectrum(char_t *, uint_t, uint_t *, modAA);
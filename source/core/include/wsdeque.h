@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2019  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include <atomic>
+
+/* Cache line size to keep the deque ends apart */
+#define WSQ_LINE                          64
+
+/*
+ * Bounded work-stealing deque (Chase-Lev, with the C11 memory
+ * orderings of Le et al.) of 64-bit task words. The owner
+ * thread pushes and pops at the bottom; any other thread may
+ * steal from the top. N must be a power of two.
+ */
+template <int_t N>
+class wsdeque
+{
+private:
+
+    alignas(WSQ_LINE) std::atomic<longlong_t> top;
+    alignas(WSQ_LINE) std::atomic<longlong_t> bottom;
+    alignas(WSQ_LINE) std::atomic<ull_t> cells[N];
+
+public:
+
+    wsdeque()
+    {
+        top.store(0, std::memory_order_relaxed);
+        bottom.store(0, std::memory_order_relaxed);
+    }
+
+    /* Owner only. Returns false if full */
+    bool_t push(ull_t task)
+    {
+        longlong_t b = bottom.load(std::memory_order_relaxed);
+        longlong_t t = top.load(std::memory_order_acquire);
+
+        if (b - t >= N)
+            return false;
+
+        cells[b & (N - 1)].store(task, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    /* Owner only. Takes the most recently pushed task */
+    bool_t pop(ull_t &task)
+    {
+        longlong_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        longlong_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        task = cells[b & (N - 1)].load(std::memory_order_relaxed);
+
+        /* Last task: race the thieves for it */
+        if (t == b)
+        {
+            bool_t won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed);
+
+            bottom.store(b + 1, std::memory_order_relaxed);
+
+            return won;
+        }
+
+        return true;
+    }
+
+    /* Any thread. Takes the oldest task */
+    bool_t steal(ull_t &task)
+    {
+        longlong_t t = top.load(std::memory_order_acquire);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        longlong_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+            return false;
+
+        task = cells[t & (N - 1)].load(std::memory_order_relaxed);
+
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    }
+
+    bool_t isEmpty()
+    {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+};
@@ -216,7 +216,10 @@ status_t initialize(lwqueue<MSQuery *>** qfPtrs, int_t& nBatches, int_t& dssize)
 
 #else
 #ifdef USE_OMP
-#pragma omp parallel for schedule (dynamic, 1)
+            // the remaining threads parse within each file
+            omp_set_max_active_levels(2);
+
+#pragma omp parallel for schedule (dynamic, 1) num_threads(std::max(1, std::min(pfiles, (int_t)params.threads)))
 #endif/* _OPENMP */
             for (auto fid = 0; fid < pfiles; fid++)
             {
@@ -17,6 +17,13 @@
  *
  */
 #include <dirent.h>
+#if __has_include(<charconv>)
+#include <charconv>
+#endif // charconv
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "msquery.hpp"
 #include "cuda/superstep2/kernel.hpp"
 
@@ -25,6 +32,9 @@ using namespace std;
 #define BIN_BATCHSIZE               50000
 #define TEMPVECTOR_SIZE             KBYTES(20)
 
+/* Bytes of an MS2 file parsed per thread per window */
+#define MS2_RANGEBYTES              MBYTES(16)
+
 extern gParams params;
 
 #if defined(USE_MPI)
@@ -38,9 +48,285 @@ MPI_File mpi_fh;
 // handle for summary.dbprep file
 std::ofstream *fh;
 
+/* Scan header (Z and I lines) of an MS2 spectrum */
+struct ms2hdr_t
+{
+    int_t   z;
+    float_t prec_mz;
+    float_t rtime;
+};
+
+/* Per-thread output of a range of MS2 spectra */
+struct ms2range_t
+{
+    std::vector<float_t>    prec_mz;
+    std::vector<float_t>    rtimes;
+    std::vector<int_t>      z;
+    std::vector<int_t>      lens;
+    std::vector<spectype_t> mzs;
+    std::vector<spectype_t> intns;
+
+    /* Raw peaks of the spectrum being parsed */
+    std::vector<spectype_t> smzs;
+    std::vector<spectype_t> sintns;
+
+    int_t largestspec = 0;
+
+    void clear()
+    {
+        prec_mz.clear();
+        rtimes.clear();
+        z.clear();
+        lens.clear();
+        mzs.clear();
+        intns.clear();
+    }
+};
+
+//
+// number of threads to parse a single MS2 file with
+//
+static int_t MS2_Threads()
+{
+#ifdef USE_OMP
+    if (omp_in_parallel())
+        return std::max(1, (int_t)params.threads / omp_get_num_threads());
+
+    return std::max(1, (int_t)params.threads);
+#else
+    return 1;
+#endif // USE_OMP
+}
+
+//
+// memory map an MS2 file for reading
+//
+static const char_t *MS2_Map(const string_t &filename, size_t &size)
+{
+    const char_t *addr = nullptr;
+    size = 0;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map != MAP_FAILED)
+        {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            addr = (const char_t *)map;
+            size = st.st_size;
+        }
+    }
+
+    /* The mapping stays valid after close */
+    close(fd);
+
+    return addr;
+}
+
+static void MS2_Unmap(const char_t *&addr, size_t &size)
+{
+    if (addr != nullptr)
+        munmap((void *)addr, size);
+
+    addr = nullptr;
+    size = 0;
+}
+
+//
+// offset of the first scan (S) line at or after off
+//
+static size_t MS2_NextScan(const char_t *base, size_t size, size_t off)
+{
+    if (off >= size)
+        return size;
+
+    if (off == 0 && base[0] == 'S')
+        return 0;
+
+    size_t pos = (off > 0) ? off - 1 : 0;
+
+    while (pos < size)
+    {
+        auto *eol = (const char_t *)memchr(base + pos, '\n', size - pos);
+
+        if (eol == nullptr)
+            return size;
+
+        pos = (eol - base) + 1;
+
+        if (pos < size && base[pos] == 'S')
+            return pos;
+    }
+
+    return size;
+}
+
+//
+// split [begin, end) into nranges ranges starting at scan lines
+//
+static void MS2_Split(const char_t *base, size_t begin, size_t end, int_t nranges, std::vector<size_t> &cuts)
+{
+    cuts.resize(nranges + 1);
+
+    cuts[0] = begin;
+    cuts[nranges] = end;
+
+    const size_t len = (end - begin) / nranges;
+
+    for (int_t r = 1; r < nranges; r++)
+        cuts[r] = std::max(cuts[r - 1], std::min(end, MS2_NextScan(base, end, begin + r * len)));
+}
+
+static inline const char_t *MS2_SkipBlanks(const char_t *p, const char_t *e)
+{
+    while (p < e && (*p == ' ' || *p == '\t'))
+        p++;
+
+    return p;
+}
+
+//
+// convert the next token in [p, e) to a number (def if no token)
+//
+template <typename T>
+static inline const char_t *MS2_Number(const char_t *p, const char_t *e, T &val, const T def)
+{
+    p = MS2_SkipBlanks(p, e);
+
+    if (p == e)
+    {
+        val = def;
+        return p;
+    }
+
+#if defined (__cpp_lib_to_chars)
+    auto [ptr, ec] = std::from_chars(p, e, val);
+
+    if (ec != std::errc())
+    {
+        val = 0;
+        ptr = p;
+    }
+#else
+    /* No floating-point from_chars: convert a NUL-terminated copy */
+    char_t tok[64];
+    size_t n = 0;
+
+    while (p + n < e && n < sizeof(tok) - 1 && p[n] != ' ' && p[n] != '\t')
+    {
+        tok[n] = p[n];
+        n++;
+    }
+
+    tok[n] = '\0';
+
+    val = (T)std::strtod(tok, nullptr);
+
+    const char_t *ptr = p + n;
+#endif // __cpp_lib_to_chars
+
+    /* Skip the rest of the token */
+    while (ptr < e && *ptr != ' ' && *ptr != '\t')
+        ptr++;
+
+    return ptr;
+}
+
+//
+// parse the spectrum whose scan line starts at off. The peaks
+// are passed to addpeak(mz, intn) in the file order and the
+// offset of the next scan line (or end) is returned
+//
+template <typename F>
+static size_t MS2_ParseSpectrum(const char_t *base, size_t off, size_t end, ms2hdr_t &hdr, F &&addpeak)
+{
+    const char_t *p = base + off;
+    const char_t *e = base + end;
+
+    hdr.z = 1;
+    hdr.prec_mz = 0.01;
+    hdr.rtime = 0;
+
+    bool_t first = true;
+
+    while (p < e)
+    {
+        auto *eol = (const char_t *)memchr(p, '\n', e - p);
+
+        if (eol == nullptr)
+            eol = e;
+
+        /* Line without the trailing \r */
+        const char_t *le = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+
+        if (p < le)
+        {
+            switch (*p)
+            {
+                case 'S':
+                    if (!first)
+                        return p - base;
+                    break;
+
+                case 'H':
+                case 'D':
+                    break;
+
+                case 'Z':
+                {
+                    auto *q = MS2_Number(p + 1, le, hdr.z, 1);
+                    double_t mass;
+                    MS2_Number(q, le, mass, 0.01);
+                    hdr.prec_mz = mass;
+                    break;
+                }
+
+                case 'I':
+                {
+                    auto *q = MS2_SkipBlanks(p + 1, le);
+
+                    if (le - q > 5 && !std::memcmp(q, "RTime", 5) && (q[5] == ' ' || q[5] == '\t'))
+                    {
+                        double_t rt;
+                        MS2_Number(q + 5, le, rt, 0.0);
+                        hdr.rtime = std::max(0.0, rt);
+                    }
+                    break;
+                }
+
+                /* MS/MS data: [m/z] [int] */
+                default:
+                {
+                    double_t mz, intn;
+                    auto *q = MS2_Number(p, le, mz, 0.01);
+                    MS2_Number(q, le, intn, 0.01);
+
+                    addpeak(mz, intn);
+                    break;
+                }
+            }
+        }
+
+        first = false;
+        p = eol + 1;
+    }
+
+    return end;
+}
+
 MSQuery::MSQuery()
 {
-    qfile = nullptr;
+    ms2addr = nullptr;
+    ms2size = 0;
+    ms2off = 0;
     currPtr = 0;
     curr_chunk = 0;
     running_count = 0;
@@ -56,11 +342,8 @@ MSQuery::~MSQuery()
     running_count = 0;
     m_isinit = false;
 
-    if (qfile != NULL)
-    {
-        delete qfile;
-        qfile = NULL;
-    }
+    unmap();
+    ms2off = 0;
 
     if (params.filetype == gParams::FileType_t::MS2)
         spectrum.deallocate();
@@ -76,265 +359,180 @@ MSQuery::~MSQuery()
 //
 std::array<int, 2> MSQuery::readMS2file(string *filename)
 {
-    /* Get a new ifstream object and open file */
-    ifstream *qqfile = new ifstream(*filename);
-
     int_t largestspec = 0;
     int_t count = 0;
-    int_t specsize = 0;
-    /* Check if file opened */
-    if (qqfile->is_open() /*&& status =SLM_SUCCESS*/)
+
+    size_t size = 0;
+    const char_t *base = MS2_Map(*filename, size);
+
+    if (base != nullptr)
     {
-        string_t line;
+        int_t nth = MS2_Threads();
+        std::vector<size_t> cuts;
 
-        /* While we still have lines in MS2 file */
-        while (!qqfile->eof())
+        MS2_Split(base, MS2_NextScan(base, size, 0), size, nth, cuts);
+
+        /* Count the scans and their peaks in parallel ranges */
+#ifdef USE_OMP
+#pragma omp parallel for num_threads(nth) schedule(static, 1) reduction(+: count) reduction(max: largestspec)
+#endif /* USE_OMP */
+        for (int_t r = 0; r < nth; r++)
         {
-            /* Read one line */
-            getline(*qqfile, line);
+            size_t off = cuts[r];
 
-            /* Empty line */
-            if (line.empty())
-            {
-                continue;
-            }
-            /* Scan: (S) */
-            else if (line[0] == 'S')
+            while (off < cuts[r + 1])
             {
+                ms2hdr_t hdr;
+                int_t specsize = 0;
+
+                off = MS2_ParseSpectrum(base, off, cuts[r + 1], hdr, [&](double_t, double_t) { specsize++; });
+
                 count++;
                 largestspec = max(specsize, largestspec);
-                specsize = 0;
-            }
-            /* Header: (H) */
-            else if (line[0] == 'H' || line[0] == 'I' || line[0] == 'D' || line[0] == 'Z')
-            {
-                /* TODO: Decide what to do with header */
-                continue;
-            }
-            /* MS/MS data: [m/z] [int] */
-            else
-            {
-                specsize++;
             }
         }
 
-        // check if the last spectrum in the file is the largest
-        largestspec = max(specsize, largestspec);
-
-        /* Close the file */
-        qqfile->close();
-
-        delete qqfile;
-
+        MS2_Unmap(base, size);
     }
     else
         cout << "Error: Unable to open qqfile: " << *filename << endl;
 
-    largestspec = max(specsize, largestspec);
-
     return std::array<int, 2>{count, largestspec};
 }
 
 std::array<int, 2> MSQuery::convertAndprepMS2bin(string *filename)
 {
     int_t largestspec = 0;
-    int_t count = 0;
     int_t globalcount = 0;
-    int_t specsize = 0;
-
-    char_t *Zsave;
-    char_t *Isave;
-
-    std::vector<spectype_t> mzs;
-    std::vector<spectype_t> intns;
 
-    // reverse 20 * 1024 vector length
-    mzs.reserve(TEMPVECTOR_SIZE);
-    intns.reserve(TEMPVECTOR_SIZE);
+    size_t size = 0;
+    const char_t *base = MS2_Map(*filename, size);
 
-    spectype_t *m_mzs = new int[BIN_BATCHSIZE * QALEN];
-    spectype_t *m_intns = new spectype_t[BIN_BATCHSIZE * QALEN];
-
-    int    m_idx = 0;
-
-    float *rtimes = new float[2 * BIN_BATCHSIZE];
-    float *prec_mz = rtimes + BIN_BATCHSIZE;
-
-    int *z = new int[2 * BIN_BATCHSIZE];
-    int *lens = z + BIN_BATCHSIZE;
-
-    /* Get a new ifstream object and open file */
-    ifstream *qqfile = new ifstream(*filename);
-
-    /* Check if file opened */
-    if (qqfile->is_open())
+    if (base != nullptr)
     {
-        string_t line;
-        bool isFirst = true;
-
-        /* While we still have lines in MS2 file */
-        while (!qqfile->eof())
-        {
-            /* Read one line */
-            getline(*qqfile, line);
-
-            if (line.empty() || line[0] == 'H' || line[0] == 'D')
-            {
-                continue;
-            }
-            /* Scan: (S) */
-            else if (line[0] == 'S')
-            {
-                if (!isFirst)
-                {
-                    // largest spectrum size
-                    largestspec = max(specsize, largestspec);
-
-                    // specsize will update here
-                    MSQuery::pickpeaks(mzs, intns, specsize, m_idx, m_intns, m_mzs);
-
-                    // write the updated specsize
-                    lens[count] = specsize;
-                    m_idx += specsize;
-
-                    count++;
-                    globalcount++;
+        int_t nth = MS2_Threads();
 
-                    // if the buffer is full, then dump to file
-                    if (count == BIN_BATCHSIZE)
-                    {
-                        // flush to the binary file
-                        MSQuery::flushBinaryFile(filename, m_mzs, m_intns, rtimes, prec_mz, z, lens, count);
-
-                        count = 0;
-                        m_idx = 0;
-                    }
-                }
-                else
-                    isFirst = false;
-
-                specsize = 0;
-
-            }
-            else if (line[0] == 'Z')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Zsave);
-                mh = strtok_r(NULL, " \t", &Zsave);
-                string_t val = "1";
+        std::vector<ms2range_t> ranges(nth);
+        std::vector<size_t> cuts;
 
-                if (mh != NULL)
-                    val = string_t(mh);
+        for (auto &rng : ranges)
+        {
+            rng.smzs.reserve(TEMPVECTOR_SIZE);
+            rng.sintns.reserve(TEMPVECTOR_SIZE);
+        }
 
-                z[count] = MAX(1, std::atoi(val.c_str()));
+        size_t pos = MS2_NextScan(base, size, 0);
 
-                val = "0.01";
-                mh = strtok_r(NULL, " \t", &Zsave);
+        /* Parse the file in windows of nth ranges and
+         * flush each window to the binary file in order */
+        while (pos < size)
+        {
+            size_t wend = MS2_NextScan(base, size, pos + (size_t)nth * MS2_RANGEBYTES);
 
-                if (mh != NULL)
-                    val = string_t(mh);
+            MS2_Split(base, pos, wend, nth, cuts);
 
-                prec_mz[count] = std::atof(val.c_str());
-            }
-            else if (line[0] == 'I')
+#ifdef USE_OMP
+#pragma omp parallel for num_threads(nth) schedule(static, 1)
+#endif /* USE_OMP */
+            for (int_t r = 0; r < nth; r++)
             {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Isave);
-                mh = strtok_r(NULL, " \t", &Isave);
-                string_t val = "";
+                auto &rng = ranges[r];
+                size_t off = cuts[r];
 
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
+                rng.clear();
 
-                if (val.compare("RTime") == 0)
+                while (off < cuts[r + 1])
                 {
-                    val = "0.00";
-                    mh = strtok_r(NULL, " \t", &Isave);
+                    ms2hdr_t hdr;
 
-                    if (mh != NULL)
+                    off = MS2_ParseSpectrum(base, off, cuts[r + 1], hdr, [&](double_t mz, double_t intn)
                     {
-                        val = string_t(mh);
-                    }
+                        // integrize the values if spectype_t is int
+                        if constexpr (std::is_same<int, spectype_t>::value)
+                        {
+                            rng.smzs.push_back(mz * params.scale);
+                            rng.sintns.push_back(intn * YAXISMULTIPLIER);
+                        }
+                        else
+                        {
+                            rng.smzs.push_back(mz);
+                            rng.sintns.push_back(intn);
+                        }
+                    });
+
+                    int_t specsize = rng.smzs.size();
+                    int_t m_idx = rng.mzs.size();
 
-                    rtimes[count] = MAX(0.0, std::atof(val.c_str()));
-                }
-            }
-            /* MS/MS data: [m/z] [int] */
-            else
-            {
-                /* Split line into two DOUBLEs
-                 * using space as delimiter */
+                    // largest spectrum size
+                    rng.largestspec = max(specsize, rng.largestspec);
 
-                char_t *mz1 = strtok_r((char_t *) line.c_str(), " ", &Zsave);
-                char_t *intn1 = strtok_r(NULL, " ", &Zsave);
-                string_t mz = "0.01";
-                string_t intn = "0.01";
+                    rng.mzs.resize(m_idx + std::max(specsize, QALEN));
+                    rng.intns.resize(m_idx + std::max(specsize, QALEN));
 
-                if (mz1 != NULL)
-                {
-                    mz = string_t(mz1);
-                }
+                    // specsize will update here
+                    MSQuery::pickpeaks(rng.smzs, rng.sintns, specsize, m_idx, rng.intns.data(), rng.mzs.data());
 
-                if (intn1 != NULL)
-                {
-                    intn = string_t(intn1);
-                }
+                    rng.mzs.resize(m_idx + specsize);
+                    rng.intns.resize(m_idx + specsize);
 
-                // integrize the values if spectype_t is int
-                if constexpr (std::is_same<int, spectype_t>::value)
-                {
-                    mzs.push_back(std::move(std::atof(mz.c_str()) * params.scale));
-                    intns.push_back(std::move(std::atof(intn.c_str()) * YAXISMULTIPLIER));
-                }
-                else
-                {
-                    mzs.push_back(std::move(std::atof(mz.c_str())));
-                    intns.push_back(std::move(std::atof(intn.c_str())));
+                    rng.z.push_back(MAX(1, hdr.z));
+                    rng.prec_mz.push_back(hdr.prec_mz);
+                    rng.rtimes.push_back(hdr.rtime);
+                    rng.lens.push_back(specsize);
                 }
-
-                // increment the spectrum size
-                specsize++;
             }
-        }
 
-        //
-        // process the last spectrum in the file here
-        //
-        largestspec = max(specsize, largestspec);
+            // flush the ranges to the binary file in order
+            for (auto &rng : ranges)
+            {
+                int_t count = rng.lens.size();
 
-        // specsize will update here
-        MSQuery::pickpeaks(mzs, intns, specsize, m_idx, m_intns, m_mzs);
+                if (count)
+                    MSQuery::flushBinaryFile(filename, rng.mzs.data(), rng.intns.data(), rng.rtimes.data(), rng.prec_mz.data(), rng.z.data(), rng.lens.data(), count);
 
-        // update lens and counts
-        lens[count] = specsize;
-        m_idx += specsize;
+                globalcount += count;
+            }
 
-        count++;
-        globalcount++;
+            pos = wend;
+        }
 
-        // flush the last batch to the file
-        MSQuery::flushBinaryFile(filename, m_mzs, m_intns, rtimes, prec_mz, z, lens, count, true);
+        for (auto &rng : ranges)
+            largestspec = max(rng.largestspec, largestspec);
 
-        /* Close the file */
-        qqfile->close();
+        // close the binary file
+        MSQuery::flushBinaryFile(filename, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, 0, true);
 
-        delete qqfile;
+        MS2_Unmap(base, size);
     }
     else
         cout << "Error: Unable to open qqfile: " << *filename << endl;
 
-    largestspec = max(specsize, largestspec);
-
-    // delete the temp arrays
-    delete[] m_mzs;
-    delete[] rtimes;
-    delete[] z;
-
     // return global count and largest spectrum length
     return std::array<int, 2>{globalcount, largestspec};
 
 }
 
+//
+// scale the (ascending) peaks below the base peak in the last QALEN
+// and count the peaks from the top that stay above the min intensity
+//
+template<typename T>
+CPU_KERNEL
+static int_t MS2_NormalizePeaks(T *intns, int_t SpectrumSize, double_t factor, int_t l_min_int)
+{
+    const int_t stt = std::max(SpectrumSize - QALEN, 0);
+
+    for (int_t j = stt; j < SpectrumSize - 1; j++)
+        intns[j] *= factor;
+
+    int_t newspeclen = 1;
+
+    for (int_t j = SpectrumSize - 2; j >= stt && intns[j] >= l_min_int; j--)
+        newspeclen++;
+
+    return newspeclen;
+}
+
 template<typename T>
 status_t MSQuery::pickpeaks(std::vector<T> &mzs, std::vector<T> &intns, int &specsize, int m_idx, T *m_intns, T *m_mzs)
 {
@@ -359,19 +557,10 @@ status_t MSQuery::pickpeaks(std::vector<T> &mzs, std::vector<T> &intns, int &spe
 
         /* Set the highest peak to base intensity */
         intns[SpectrumSize - 1] = params.base_int;
-        int newspeclen = 1;
-
-        /* Scale the rest of the peaks to the base peak */
-        for (int_t j = SpectrumSize - 2; j >= (SpectrumSize - QALEN) && j >= 0; j--)
-        {
-            intns[j] *= factor;
 
-            if (intns[j] >= l_min_int)
-                newspeclen++;
-            // since sorted in ascending order. TODO: Check if this is correct
-            else
-                break;
-        }
+        /* Scale the rest of the peaks to the base peak. The peaks
+         * below the first one under l_min_int are not copied out */
+        int newspeclen = MS2_NormalizePeaks(intns.data(), SpectrumSize, factor, l_min_int);
 #else
         // STL-based code for intensity normalization
 
@@ -422,45 +611,160 @@ status_t MSQuery::pickpeaks(std::vector<T> &mzs, std::vector<T> &intns, int &spe
     return SLM_SUCCESS;
 }
 
+//
+// fill in the .pbin header for the current parameters
+//
+static bool_t MS2_BinaryHeader(const string_t &ms2file, pbinHeader &hdr)
+{
+    std::memset(&hdr, 0x0, sizeof(pbinHeader));
+
+    std::memcpy(hdr.magic, PBIN_MAGIC, sizeof(PBIN_MAGIC));
+    hdr.version   = PBIN_VERSION;
+    hdr.hdrsize   = sizeof(pbinHeader);
+    hdr.spectsize = sizeof(spectype_t);
+    hdr.scale     = params.scale;
+    hdr.qalen     = QALEN;
+    hdr.qchunk    = QCHUNK;
+    hdr.yaxis     = YAXISMULTIPLIER;
+    hdr.base_int  = params.base_int;
+    hdr.min_int   = params.min_int;
+
+    struct stat st;
+
+    if (stat(ms2file.c_str(), &st) != 0)
+        return false;
+
+    hdr.ms2size  = st.st_size;
+    hdr.ms2mtime = st.st_mtime;
+
+    return true;
+}
+
+/* .pbin writer state of a thread */
+struct pbinwriter_t
+{
+    std::ofstream           file;
+    pbinHeader              hdr;
+    std::vector<ull_t>      table;
+
+    /* spectra of the batch being filled */
+    std::vector<float_t>    prec_mz;
+    std::vector<int_t>      z;
+    std::vector<float_t>    rtimes;
+    std::vector<uint_t>     idx;
+    std::vector<spectype_t> mzs;
+    std::vector<spectype_t> intns;
+
+    void writebatch()
+    {
+        if (idx.size() < 2)
+            return;
+
+        ull_t npeaks = mzs.size();
+        const char_t pad[8] = {0};
+
+        table.push_back(file.tellp());
+
+        file.write((char *)&npeaks, sizeof(ull_t));
+        file.write((char *)prec_mz.data(), sizeof(float_t) * prec_mz.size());
+        file.write((char *)z.data(), sizeof(int_t) * z.size());
+        file.write((char *)rtimes.data(), sizeof(float_t) * rtimes.size());
+        file.write((char *)idx.data(), sizeof(uint_t) * idx.size());
+        file.write((char *)mzs.data(), sizeof(spectype_t) * npeaks);
+        file.write((char *)intns.data(), sizeof(spectype_t) * npeaks);
+
+        // keep the next batch aligned
+        file.write(pad, (8 - file.tellp() % 8) % 8);
+
+        hdr.count += idx.size() - 1;
+
+        prec_mz.clear();
+        z.clear();
+        rtimes.clear();
+        idx.assign(1, 0);
+        mzs.clear();
+        intns.clear();
+    }
+};
+
 void MSQuery::flushBinaryFile(string *filename, spectype_t *m_mzs, spectype_t *m_intns, float *rtimes, float *prec_mz, int *z, int *lens, int count, bool close)
 {
-    static thread_local bool_t isNewFile = true;
-    static thread_local std::ofstream qbFile;
+    static thread_local pbinwriter_t wr;
 
-    if (isNewFile)
+    if (!wr.file.is_open())
     {
-        qbFile.open(*filename + ".pbin", ios::binary);
-        isNewFile = false;
+        MS2_BinaryHeader(*filename, wr.hdr);
+        wr.table.clear();
+        wr.idx.assign(1, 0);
+
+        wr.file.open(*filename + ".pbin", ios::binary);
+
+        // placeholder header, rewritten on close
+        wr.file.write((char *)&wr.hdr, sizeof(pbinHeader));
     }
 
-    if (qbFile.is_open())
+    if (wr.file.is_open())
     {
         int ind = 0;
 
         for (int i = 0; i < count; i++)
         {
-            qbFile.write((char *)&prec_mz[i], sizeof(float));
-            qbFile.write((char *)&z[i], sizeof(int));
-            qbFile.write((char *)&rtimes[i], sizeof(float));
-            qbFile.write((char *)&lens[i], sizeof(int));
+            wr.prec_mz.push_back(prec_mz[i]);
+            wr.z.push_back(z[i]);
+            wr.rtimes.push_back(rtimes[i]);
+            wr.idx.push_back(wr.idx.back() + lens[i]);
 
-            qbFile.write((char *)&m_mzs[ind], sizeof(spectype_t) * lens[i]);
-            qbFile.write((char *)&m_intns[ind], sizeof(spectype_t) * lens[i]);
+            wr.mzs.insert(wr.mzs.end(), m_mzs + ind, m_mzs + ind + lens[i]);
+            wr.intns.insert(wr.intns.end(), m_intns + ind, m_intns + ind + lens[i]);
 
             ind += lens[i];
+
+            // write full batches
+            if (wr.idx.size() == QCHUNK + 1)
+                wr.writebatch();
         }
     }
     else
-        std::cerr << "Could not open file " << filename << ".pbin" << std::endl;
+        std::cerr << "Could not open file " << *filename << ".pbin" << std::endl;
 
-    if (close)
+    if (close && wr.file.is_open())
     {
-        qbFile.flush();
-        qbFile.close();
-        isNewFile = true;
+        wr.writebatch();
+
+        // write the batch offset table and the final header
+        wr.hdr.nbatches = wr.table.size();
+        wr.hdr.tableoff = wr.file.tellp();
+
+        wr.file.write((char *)wr.table.data(), sizeof(ull_t) * wr.table.size());
+
+        wr.file.seekp(0);
+        wr.file.write((char *)&wr.hdr, sizeof(pbinHeader));
+
+        wr.file.flush();
+        wr.file.close();
     }
 }
 
+//
+// check if the .pbin file of an MS2 file is current
+//
+bool MSQuery::verifyBinaryFile(const string_t &ms2file)
+{
+    pbinHeader expected, hdr;
+
+    if (!MS2_BinaryHeader(ms2file, expected))
+        return false;
+
+    std::ifstream file(ms2file + ".pbin", ios::in | ios::binary);
+
+    if (!file.is_open() || !file.read((char *)&hdr, sizeof(pbinHeader)))
+        return false;
+
+    // everything but the contents must match
+    return !std::memcmp(&hdr, &expected, offsetof(pbinHeader, count)) &&
+           hdr.nbatches == (hdr.count + QCHUNK - 1) / QCHUNK;
+}
+
 /*
  * FUNCTION:
  *
@@ -592,6 +896,10 @@ bool MSQuery::init_index(const std::vector<string_t> &queryfiles)
                 string_t tempfile = ms2file + ".pbin";
                 if (std::find(pbinfiles.begin(), pbinfiles.end(), tempfile) == pbinfiles.end())
                     return false;
+
+                // check if the file is current
+                if (!MSQuery::verifyBinaryFile(ms2file))
+                    return false;
             }
         }
         else
@@ -744,24 +1052,40 @@ status_t MSQuery::extractbatch(uint_t count, Queries<T> *expSpecs, int_t &rem)
     }
 
     expSpecs->numSpecs = count;
-    expSpecs->idx[0] = 0; //Set starting point to zero.
 
-    if (qfile == NULL || qfile->is_open() == false)
+    if (ms2addr == NULL)
     {
-        /* Get a new ifstream object and open file */
-        qfile = new ifstream;
+        // Map the binary or text file
+        ms2addr = MS2_Map(MS2file, ms2size);
+
+        if (ms2addr != NULL && params.filetype == gParams::FileType_t::PBIN &&
+            (ms2size < sizeof(pbinHeader) || std::memcmp(ms2addr, PBIN_MAGIC, sizeof(PBIN_MAGIC)) ||
+             ((const pbinHeader *)ms2addr)->version != PBIN_VERSION))
+        {
+            MS2_Unmap(ms2addr, ms2size);
+        }
+
+        // the .pbin mapping is shared with the Queries viewing it
+        if (ms2addr != NULL && params.filetype == gParams::FileType_t::PBIN)
+        {
+            size_t size = ms2size;
+            pbinmap = std::shared_ptr<const char_t>(ms2addr, [size](const char_t *addr) mutable { MS2_Unmap(addr, size); });
+        }
 
-        // Open file as bin or simple text
-        (params.filetype == gParams::FileType_t::PBIN)? qfile->open(MS2file, ios::in | ios::binary) : qfile->open(MS2file, ios::in);
+        // locate the first scan in the text file
+        if (ms2addr != NULL && params.filetype == gParams::FileType_t::MS2)
+            ms2off = MS2_NextScan(ms2addr, ms2size, 0);
     }
 
     /* Check if file opened */
-    if (qfile->is_open() /*&& status =SLM_SUCCESS*/)
+    if (ms2addr != NULL)
     {
         if (params.filetype == gParams::FileType_t::PBIN)
             readBINbatch<T>(startspec, endspec, expSpecs);
         else
         {
+            expSpecs->idx[0] = 0; //Set starting point to zero.
+
             for (uint_t spec = startspec; spec < endspec; spec++)
             {
                 readMS2spectrum();
@@ -791,246 +1115,121 @@ status_t MSQuery::extractbatch(uint_t count, Queries<T> *expSpecs, int_t &rem)
 template <typename T>
 void MSQuery::readBINbatch(int startspec, int endspec, Queries<T> *expSpecs)
 {
-    auto prec_mz = expSpecs->precurse;
-    auto z = expSpecs->charges;
-    auto rtimes = expSpecs->rtimes;
-    auto lens = expSpecs->idx;
-    auto m_mzs = expSpecs->moz;
-    auto m_intns = expSpecs->intensity;
+    auto *hdr = (const pbinHeader *)ms2addr;
+    auto *table = (const ull_t *)(ms2addr + hdr->tableoff);
 
-    int ind = 0;
-
-    if (qfile->is_open())
-    {
-        // temporary spectrum length variable
-        int_t clen = 0;
+    const int_t qchunk = hdr->qchunk;
+    const int_t nspecs = hdr->count;
 
-        // lens[0] must be 0
-        lens[0] = 0;
+    endspec = std::min(endspec, nspecs);
 
-        auto count = (endspec - startspec);
+    /* A whole batch is searched in place from the mapped file */
+    if (startspec % qchunk == 0 && endspec == std::min(startspec + qchunk, nspecs))
+    {
+        const char_t *blk = ms2addr + table[startspec / qchunk];
+        const int_t n = endspec - startspec;
 
-        // FIXME: are loop limits correct?
-        for (int i = 0; i < count; i++)
-        {
-            qfile->read((char *)&prec_mz[i], sizeof(float));
-            qfile->read((char *)&z[i], sizeof(int));
-            qfile->read((char *)&rtimes[i], sizeof(float));
-            qfile->read((char *)&clen, sizeof(int));
+        ull_t npeaks;
+        std::memcpy(&npeaks, blk, sizeof(ull_t));
 
-            qfile->read((char *)&m_mzs[ind], sizeof(T) * clen);
-            qfile->read((char *)&m_intns[ind], sizeof(T) * clen);
+        auto *bprec = (const float_t *)(blk + sizeof(ull_t));
+        auto *bz    = (const int_t *)(bprec + n);
+        auto *brt   = (const float_t *)(bz + n);
+        auto *bidx  = (const uint_t *)(brt + n);
+        auto *bmzs  = (const T *)(bidx + n + 1);
 
-            ind += clen;
-            lens[i+1] = lens[i] + clen;
+        expSpecs->view(pbinmap, bidx, bprec, bz, brt, bmzs, bmzs + npeaks, n, npeaks);
 
-        }
+        return;
     }
 
-    // set the total number of peaks
-    expSpecs->numPeaks = ind;
-}
-
-VOID MSQuery::readMS2spectrum()
-{
-    string_t line;
-    uint_t speclen = 0;
-    char_t *saveptr;
-    char_t *Isave;
-
-    /* Check if this is the first spectrum in file */
-    if (currPtr == 0)
+    /* Otherwise, copy the spectra into owned buffers */
+    if (expSpecs->isView() || expSpecs->moz == NULL)
     {
-        BOOL scan = false;
+        expSpecs->init();
+        expSpecs->numSpecs = endspec - startspec;
+    }
 
-        while (!qfile->eof())
-        {
-            /* Read one line */
-            getline(*qfile, line);
+    auto prec_mz = expSpecs->precurse;
+    auto z = expSpecs->charges;
+    auto rtimes = expSpecs->rtimes;
+    auto lens = expSpecs->idx;
+    auto m_mzs = expSpecs->moz;
+    auto m_intns = expSpecs->intensity;
 
-            /* Empty line */
-            if (line.empty() || line[0] == 'H' || line[0] == 'D')
-            {
-                continue;
-            }
-            else if (line[0] == 'Z')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &saveptr);
-                mh = strtok_r(NULL, " \t", &saveptr);
-                string_t val = "1";
+    int ind = 0;
+    int i = 0;
 
-                if (mh != NULL)
-                    val = string_t(mh);
+    // lens[0] must be 0
+    lens[0] = 0;
 
-                spectrum.Z = std::atoi(val.c_str());
+    /* Copy the columns of each batch overlapping [startspec, endspec) */
+    for (int spec = startspec; spec < endspec;)
+    {
+        const int_t bno = spec / qchunk;
+        const int_t first = bno * qchunk;
+        const int_t n = std::min(qchunk, nspecs - first);
 
-                val = "0.01";
-                mh = strtok_r(NULL, " \t", &saveptr);
+        const char_t *blk = ms2addr + table[bno];
 
-                if (mh != NULL)
-                    val = string_t(mh);
+        ull_t npeaks;
+        std::memcpy(&npeaks, blk, sizeof(ull_t));
 
-                spectrum.prec_mz = (double_t)std::atof(val.c_str());
-            }
-            else if (line[0] == 'I')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Isave);
-                mh = strtok_r(NULL, " \t", &Isave);
-                string_t val = "";
+        auto *bprec = (const float_t *)(blk + sizeof(ull_t));
+        auto *bz    = (const int_t *)(bprec + n);
+        auto *brt   = (const float_t *)(bz + n);
+        auto *bidx  = (const uint_t *)(brt + n);
+        auto *bmzs  = (const T *)(bidx + n + 1);
+        auto *bints = bmzs + npeaks;
 
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
+        const int_t k0 = spec - first;
+        const int_t m = std::min(n, endspec - first) - k0;
 
-                if (val.compare("RTime") == 0)
-                {
-                    val = "0.00";
-                    mh = strtok_r(NULL, " \t", &Isave);
+        // peaks before the first requested spectrum
+        const ull_t p0 = bidx[k0];
 
-                    if (mh != NULL)
-                    {
-                        val = string_t(mh);
-                    }
+        std::memcpy(prec_mz + i, bprec + k0, sizeof(float_t) * m);
+        std::memcpy(z + i, bz + k0, sizeof(int_t) * m);
+        std::memcpy(rtimes + i, brt + k0, sizeof(float_t) * m);
 
-                    spectrum.rtime = (double_t)std::atof(val.c_str());
-                }
-            }
-            else if (line[0] == 'S')
-            {
-                if (scan == true)
-                {
-                    spectrum.SpectrumSize = speclen;
-                    break;
-                }
-                else
-                    scan = true;
-            }
-            /* Values */
-            else
-            {
-                /* Split line into two DOUBLEs
-                 * using space as delimiter */
+        for (int_t k = 0; k < m; k++)
+            lens[i + k + 1] = lens[i + k] + bidx[k0 + k + 1] - bidx[k0 + k];
 
-                char_t *mz1 = strtok_r((char_t *) line.c_str(), " ", &saveptr);
-                char_t *intn1 = strtok_r(NULL, " ", &saveptr);
-                string_t mz = "0.01";
-                string_t intn = "0.01";
+        const int_t np = lens[i + m] - lens[i];
 
-                if (mz1 != NULL)
-                {
-                    mz = string_t(mz1);
-                }
+        std::memcpy(m_mzs + ind, bmzs + p0, sizeof(T) * np);
+        std::memcpy(m_intns + ind, bints + p0, sizeof(T) * np);
 
-                if (intn1 != NULL)
-                {
-                    intn = string_t(intn1);
-                }
+        ind += np;
+        i += m;
+        spec += m;
+    }
 
-                spectrum.mz[speclen] = (uint_t)((double_t)std::atof(mz.c_str()) * params.scale);
-                spectrum.intn[speclen] = (uint_t)((double_t)std::atof(intn.c_str()) * YAXISMULTIPLIER);
+    // set the total number of peaks
+    expSpecs->numPeaks = ind;
+}
 
-                speclen++;
-            }
-        }
+VOID MSQuery::readMS2spectrum()
+{
+    ms2hdr_t hdr;
+    uint_t speclen = 0;
 
-        spectrum.SpectrumSize = speclen;
-    }
-    /* Not the first spectrum in file */
-    else
+    /* Parse the next spectrum from the mapped file */
+    ms2off = MS2_ParseSpectrum(ms2addr, ms2off, ms2size, hdr, [&](double_t mz, double_t intn)
     {
-        while (!qfile->eof())
+        if (speclen < info.maxslen)
         {
-            /* Read one line */
-            getline(*qfile, line);
-
-            /* Empty line */
-            if (line.empty() || line[0] == 'H' || line[0] == 'D')
-            {
-                continue;
-            }
-            else if (line[0] == 'Z')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &saveptr);
-                mh = strtok_r(NULL, " \t", &saveptr);
-                string_t val = "1";
-
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
-
-                spectrum.Z = std::atoi(val.c_str());
+            spectrum.mz[speclen] = (uint_t)(mz * params.scale);
+            spectrum.intn[speclen] = (uint_t)(intn * YAXISMULTIPLIER);
 
-                val = "0.01";
-                mh = strtok_r(NULL, " \t", &saveptr);
-
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
-
-                spectrum.prec_mz = (double_t)std::atof(val.c_str());
-
-            }
-            else if (line[0] == 'I')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Isave);
-                mh = strtok_r(NULL, " \t", &Isave);
-                string_t val = "";
-
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
-
-                if (val.compare("RTime") == 0)
-                {
-                    val = "0.00";
-                    mh = strtok_r(NULL, " \t", &Isave);
-
-                    if (mh != NULL)
-                    {
-                        val = string_t(mh);
-                    }
-
-                    spectrum.rtime = (double_t)std::atof(val.c_str());
-                }
-            }
-            else if (line[0] == 'S')
-            {
-                spectrum.SpectrumSize = speclen;
-                break;
-            }
-            /* Values */
-            else
-            {
-                /* Split line into two DOUBLEs
-                 * using space as delimiter */
-                char_t *mz1 = strtok_r((char_t *) line.c_str(), " ", &saveptr);
-                char_t *intn1 = strtok_r(NULL, " ", &saveptr);
-
-                string_t mz = "0.0";
-                string_t intn = "0.0";
-
-                if (mz1 != NULL)
-                {
-                    mz = string_t(mz1);
-                }
-                if (intn1 != NULL)
-                {
-                    intn = string_t(intn1);
-                }
-
-                spectrum.mz[speclen] = (uint_t)((double_t)std::atof(mz.c_str()) * params.scale);
-                spectrum.intn[speclen] = (uint_t)((double_t)std::atof(intn.c_str()) * YAXISMULTIPLIER);
-
-                speclen++;
-            }
+            speclen++;
         }
+    });
 
-        spectrum.SpectrumSize = speclen;
-    }
+    spectrum.Z = hdr.z;
+    spectrum.prec_mz = hdr.prec_mz;
+    spectrum.rtime = hdr.rtime;
+    spectrum.SpectrumSize = speclen;
 }
 
 template <typename T>
@@ -1056,20 +1255,9 @@ status_t MSQuery::pickpeaks(Queries<T> *expSpecs)
 
         /* Set the highest peak to base intensity */
         dIntArr[SpectrumSize - 1] = params.base_int;
-        speclen = 1;
-
-        uint_t l_min_int = params.min_int; //0.01 * dIntArr[SpectrumSize - 1];
 
         /* Scale the rest of the peaks to the base peak */
-        for (int_t j = SpectrumSize - 2; j >= (SpectrumSize - QALEN) && j >= 0; j--)
-        {
-            dIntArr[j] *= factor;
-
-            if (dIntArr[j] >= l_min_int)
-            {
-                speclen++;
-            }
-        }
+        speclen = MS2_NormalizePeaks(dIntArr, SpectrumSize, factor, params.min_int);
     }
 
     /* Update the indices */
@@ -1110,13 +1298,8 @@ status_t MSQuery::DeinitQueryFile()
     qfileIndex = 0;
     info.maxslen = 0;
 
-    if (qfile != NULL)
-    {
-        qfile->close();
-
-        delete qfile;
-        qfile = NULL;
-    }
+    unmap();
+    ms2off = 0;
 
     if (params.filetype == gParams::FileType_t::MS2)
         spectrum.deallocate();
@@ -1129,7 +1312,23 @@ status_t MSQuery::DeinitQueryFile()
     return SLM_SUCCESS;
 }
 
-BOOL MSQuery::isDeInit() { return ((qfile == NULL) && (info.QAcount == 0)); }
+//
+// release the mapped file, the .pbin mapping is
+// unmapped once no Queries view it anymore
+//
+void MSQuery::unmap()
+{
+    if (pbinmap != nullptr)
+    {
+        pbinmap.reset();
+        ms2addr = nullptr;
+        ms2size = 0;
+    }
+    else
+        MS2_Unmap(ms2addr, ms2size);
+}
+
+BOOL MSQuery::isDeInit() { return ((ms2addr == NULL) && (info.QAcount == 0)); }
 
 /* Operator Overload - To copy to and from the work queue */
 MSQuery& MSQuery::operator=(const MSQuery &rhs)
@@ -1140,7 +1339,10 @@ MSQuery& MSQuery::operator=(const MSQuery &rhs)
     this->curr_chunk = rhs.curr_chunk;
     this->info.maxslen = rhs.info.maxslen;
     this->info.nqchunks = rhs.info.nqchunks;
-    this->qfile = rhs.qfile;
+    this->ms2addr = rhs.ms2addr;
+    this->ms2size = rhs.ms2size;
+    this->ms2off = rhs.ms2off;
+    this->pbinmap = rhs.pbinmap;
     this->running_count = rhs.running_count;
     this->spectrum = rhs.spectrum;
     this->qfileIndex = rhs.qfileIndex;
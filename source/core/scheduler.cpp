@@ -56,7 +56,10 @@ Scheduler::Scheduler()
     alpha = alpha1 = 0.5;
     gamma = gamma1 = 0.8;
 
-    // Create at most IO threads
+    /* Create the parked I/O workers */
+    startPool();
+
+    // Dispatch at most 2 IO threads
     auto ts = std::min(maxIOThds, 2);
     for (auto t = 0; t < ts; t++)
         dispatchThread();
@@ -91,7 +94,10 @@ Scheduler::Scheduler(int_t maxio)
     alpha = alpha1 = 0.5;
     gamma = gamma1 = 0.8;
 
-    // Create at most IO threads
+    /* Create the parked I/O workers */
+    startPool();
+
+    // Dispatch at most 2 IO threads
     auto ts = std::min(maxIOThds, 2);
     for (auto t = 0; t < ts; t++)
         dispatchThread();
@@ -99,6 +105,17 @@ Scheduler::Scheduler(int_t maxio)
 
 Scheduler::~Scheduler()
 {
+    /* Unpark all workers to exit */
+    poolexit = true;
+
+    for (size_t w = 0; w < thread_pool.size(); w++)
+        sem_post(&wakeup);
+
+    for (auto &itr : thread_pool)
+        itr.join();
+
+    thread_pool.clear();
+
     /* Thresholds */
     maxpenalty = 0;
     maxIOThds = 0;
@@ -119,12 +136,38 @@ Scheduler::~Scheduler()
     alpha = alpha1 = 0;
     gamma = gamma1 = 0;
 
-    for (auto &itr : thread_pool)
-        itr.join();
+    sem_destroy(&wakeup);
+    sem_destroy(&manage);
+}
 
-    thread_pool.clear();
+//
+// create the I/O worker pool
+//
+VOID Scheduler::startPool()
+{
+    poolexit = false;
 
-    sem_destroy(&manage);
+    sem_init(&wakeup, 0, 0);
+
+    for (auto w = 0; w < maxIOThds; w++)
+        thread_pool.push_back(std::thread(&Scheduler::ioWorker, this));
+}
+
+//
+// park until dispatched, run the I/O until retired
+// or preempted, and park again on the same thread
+//
+VOID Scheduler::ioWorker()
+{
+    for (;;)
+    {
+        sem_wait(&wakeup);
+
+        if (poolexit)
+            break;
+
+        DSLIM_IO_Threads_Entry();
+    }
 }
 
 double_t Scheduler::forecastLASP(double_t yt)
@@ -264,13 +307,30 @@ status_t Scheduler::dispatchThread()
     {
         nIOThds += 1;
 
-        /* Pass the reference to thread block as argument */
-        thread_pool.push_back(std::move(std::thread(DSLIM_IO_Threads_Entry)));
+        /* Unpark a worker of the pool */
+        sem_post(&wakeup);
     }
 
     return SLM_SUCCESS;
 }
 
+//
+// dispatch an I/O thread if none is running
+//
+status_t Scheduler::dispatchIdle()
+{
+    status_t status = SLM_SUCCESS;
+
+    sem_wait(&manage);
+
+    if (nIOThds < 1)
+        status = dispatchThread();
+
+    sem_post(&manage);
+
+    return status;
+}
+
 status_t Scheduler::takeControl()
 {
     sem_wait(&manage);
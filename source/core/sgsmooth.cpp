@@ -442,17 +442,67 @@ static float_vect sg_coeff(const float_vect &b, const size_t deg)
     return res;
 }
 
+//! largest (half) window width and degree kept in the coefficient table
+#define SG_MAXWIDTH                        3
+#define SG_MAXDEG                          5
+#define SG_MAXWINDOW                       (2 * SG_MAXWIDTH + 1)
+
+/*! table of savitzky golay coefficients.
+ *
+ * row i < w holds the coefficients of the i'th border point and row w
+ * the "symmetric" coefficients of a window of width 2w+1. only the
+ * well-posed pairs (deg < 2w+1) are kept. the table is built once on
+ * first use (thread-safe static initialization) so that sg_smooth does
+ * not invert a matrix per call. */
+struct sg_table
+{
+    double coeff[SG_MAXWIDTH + 1][SG_MAXDEG + 1][SG_MAXWIDTH + 1][SG_MAXWINDOW];
+
+    sg_table()
+    {
+        for (int w = 1; w <= SG_MAXWIDTH; ++w)
+        {
+            const int window = 2 * w + 1;
+
+            for (int deg = 1; deg <= SG_MAXDEG && deg < window; ++deg)
+            {
+                for (int i = 0; i <= w; ++i)
+                {
+                    float_vect b(window, 0.0);
+                    b[i] = 1.0;
+
+                    const float_vect c(sg_coeff(b, deg));
+
+                    for (int j = 0; j < window; ++j)
+                        coeff[w][deg][i][j] = c[j];
+                }
+            }
+        }
+    }
+
+    static bool has(const int width, const int deg)
+    {
+        return width <= SG_MAXWIDTH && deg <= SG_MAXDEG && deg < 2 * width + 1;
+    }
+};
+
+//! get the coefficient table
+static const sg_table &sg_coefftable()
+{
+    static const sg_table table;
+    return table;
+}
+
 /*! \brief savitzky golay smoothing.
  *
  * This method means fitting a polynome of degree 'deg' to a sliding window
  * of width 2w+1 throughout the data.  The needed coefficients are
- * generated dynamically by doing a least squares fit on a "symmetric" unit
- * vector of size 2w+1, e.g. for w=2 b=(0,0,1,0,0). evaluating the polynome
- * yields the sg-coefficients.  at the border non symmectric vectors b are
- * used. */
+ * generated by doing a least squares fit on a "symmetric" unit vector of
+ * size 2w+1, e.g. for w=2 b=(0,0,1,0,0). evaluating the polynome yields
+ * the sg-coefficients.  at the border non symmectric vectors b are used.
+ * the coefficients of small windows are looked up from the sg_table. */
 void sg_smooth(lwvector<double> *v, lwvector<double> *res, const int width, const int deg)
 {
-    /* Results vector */
     /* Constants */
     const int window = 2 * width + 1;
     const int endidx = v->Size() - 1;
@@ -463,94 +513,95 @@ void sg_smooth(lwvector<double> *v, lwvector<double> *res, const int width, cons
         return;
     }
 
+    const double *x = v->begin();
+    double *y = res->begin();
+
     // do a regular sliding window average
     int i, j;
 
     if (deg == 0)
     {
-#if 0 /* No need of OpenMP as already multithreaded */
-#if defined(_OPENMP)
-#pragma omp parallel for private(i,j) schedule(static)
-#endif
-#endif
         // handle border cases first because we need different coefficient
         for (i = 0; i < width; ++i)
         {
             const double scale = 1.0 / double(i + 1);
-            float_vect c1(width, scale);
+
             for (j = 0; j <= i; ++j)
             {
-                (*res)[i] += c1[j] * (*v)[j];
-                (*res)[endidx - i] += c1[j] * (*v)[endidx - j];
+                y[i] += scale * x[j];
+                y[endidx - i] += scale * x[endidx - j];
             }
-
-            c1.clear();
         }
 
         // now loop over rest of data. reusing the "symmetric" coefficients.
         const double scale = 1.0 / double(window);
-        float_vect c2(window, scale);
 
-#if 0 /* No need of OpenMP as already multithreaded */
-#if defined(_OPENMP)
-#pragma omp parallel for private(i,j) schedule(static)
-#endif
-#endif
         for (i = 0; i <= ((int) v->Size() - window); ++i)
         {
             for (j = 0; j < window; ++j)
             {
-                (*res)[i + width] += c2[j] * (*v)[i + j];
+                y[i + width] += scale * x[i + j];
             }
         }
-
-        c2.clear();
     }
     else // (deg > 0)
     {
+        std::vector<float_vect> coeffs;
+
+        // coefficient rows 0..width
+        const double *rows[SG_MAXWIDTH + 1];
+        std::vector<const double *> lrows;
+        const double **c = rows;
+
+        if (sg_table::has(width, deg))
+        {
+            for (i = 0; i <= width; ++i)
+                rows[i] = sg_coefftable().coeff[width][deg][i];
+        }
+        else
+        {
+            // not in the table: compute the coefficients
+            lrows.resize(width + 1);
+            coeffs.resize(width + 1);
+
+            for (i = 0; i <= width; ++i)
+            {
+                float_vect b(window, 0.0);
+                b[i] = 1.0;
+
+                coeffs[i] = sg_coeff(b, deg);
+                lrows[i] = coeffs[i].data();
+            }
+
+            c = lrows.data();
+        }
 
-#if 0 /* No need of OpenMP as already multithreaded */
-#if defined(_OPENMP)
-#pragma omp parallel for private(i,j) schedule(static)
-#endif
-#endif
         // handle border cases first because we need different coefficients
         for (i = 0; i < width; ++i)
         {
-            float_vect b1(window, 0.0);
-            b1[i] = 1.0;
+            const double *c1 = c[i];
 
-            float_vect c1(sg_coeff(b1, deg));
             for (j = 0; j < window; ++j)
             {
-                (*res)[i] += c1[j] * (*v)[j];
-                (*res)[endidx - i] += c1[j] * (*v)[endidx - j];
+                y[i] += c1[j] * x[j];
+                y[endidx - i] += c1[j] * x[endidx - j];
             }
-
-            b1.clear();
-            c1.clear();
         }
 
         // now loop over rest of data. reusing the "symmetric" coefficients.
-        float_vect b2(window, 0.0);
-        b2[width] = 1.0;
-        float_vect c2(sg_coeff(b2, deg));
+        const double *c2 = c[width];
 
-#if 0 /* No need of OpenMP as already multithreaded */
-#if defined(_OPENMP)
-#pragma omp parallel for private(i,j) schedule(static)
-#endif
-#endif
         for (i = 0; i <= ((int) v->Size() - window); ++i)
         {
+            double sum = y[i + width];
+
             for (j = 0; j < window; ++j)
             {
-                (*res)[i + width] += c2[j] * (*v)[i + j];
+                sum += c2[j] * x[i + j];
             }
-        }
 
-        b2.clear();
-        c2.clear();
+            y[i + width] = sum;
+        }
     }
 }
 
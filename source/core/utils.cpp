@@ -59,6 +59,33 @@ uint_t UTILS_GetNumProcs()
     return procs;
 }
 
+/*
+ * FUNCTION: UTILS_DispatchISA
+ *
+ * DESCRIPTION: Get the instruction set of the CPU_KERNEL
+ *              clones selected for this CPU at load time
+ *
+ * INPUT: none
+ *
+ * OUTPUT:
+ * @isa: Name of the selected instruction set
+ */
+const char *UTILS_DispatchISA()
+{
+#if defined(CPU_DISPATCH) && defined(__x86_64__) && defined(__GNUC__)
+    /* Same priority as the target_clones resolver */
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return "avx512f";
+
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+#endif // CPU_DISPATCH
+
+    return "default";
+}
+
 /*
  * FUNCTION: UTILS_Factorial
  *
@@ -148,78 +175,129 @@ status_t UTILS_ShuffleI(uint_t *arr, uint_t N, ull_t seed)
 /*
  * FUNCTION: UTILS_GenerateSpectrum
  *
- * DESCRIPTION: Generates theoretical spectrum of a peptide
+ * DESCRIPTION: Generates theoretical spectrum of a (modified)
+ *              peptide directly into the Spectrum. The b- and
+ *              y-ion ladders of all charges are extended in one
+ *              pass over the residues and the mod masses are
+ *              added using the prefix count of mod sites.
  *
  * INPUT:
  * @seq     : Peptide sequence
  * @len     : Length of peptide
  * @Spectrum: Pointer to the theoretical spectrum
+ * @modInfo : Modified peptide information (modNum = 0 if none)
+ * @ladder  : Scratch space for iSERIES * maxz ions
  *
  * OUTPUT:
  * @mass: Precursor mass of peptide
  */
-float_t UTILS_GenerateSpectrum(char_t *seq, uint_t len, uint_t *Spectrum)
+CPU_KERNEL
+float_t UTILS_GenerateSpectrum(AA *seq, uint_t len, uint_t *Spectrum, modAA &modInfo, float_t *ladder)
 {
-    /* Calculate Peptide sequences Mass */
-    float_t mass = UTILS_CalculatePepMass(seq, len);
+    const uint_t maxz = params.maxz;
+    const uint_t scale = params.scale;
+    const uint_t nions = len - 1;
+    const bool_t modified = (modInfo.modNum != 0);
 
-    uint_t maxz = params.maxz;
-    uint_t scale = params.scale;
+    float_t mass = 0;
+
+    /* Mod mass deltas in the b- and y-ion order */
+    double_t bdelta[MAX_MOD_TYPES] = {};
+    double_t ydelta[MAX_MOD_TYPES] = {};
+
+    /* Check if valid modInfo */
+    if (modified && modInfo.sites == 0)
+        return NAA;
+
+    /* Calculate peptide (or mod) mass */
+    mass = (modified) ? UTILS_CalculateModMass(seq, len, modInfo.modNum) :
+                        UTILS_CalculatePepMass(seq, len);
 
     /* If there is a non-AA char, the mass will be -ve */
     /* FIXME: No stupid characters should be allowed in
      *        peptide sequence */
-    if (mass > 0)
+    if (mass <= 0)
+        return mass;
+
+    if (modified)
     {
-        // vector for floating point spectrum
-        std::vector<float_t> f_Spectrum(iSERIES * maxz * (len-1));
+        int_t modNums[MAX_MOD_TYPES] = {};
+        int_t modSeen = 0;
+        uint_t bitmask = modInfo.modNum;
 
-        /* Generate Spectrum */
-        for (uint_t z = 0; z < maxz; z++)
+        for (uint_t i = 0; i < MAX_MOD_TYPES; i++)
         {
-            /* Indices for b and y series start */
-            uint_t bstart = z * (len - 1);
-            uint_t ystart = z * (len - 1) + maxz * (len - 1);
-
-            /* Mass of fragment = [M + (z-1)H]/z */
-
-            /* First b-ion */
-            f_Spectrum[bstart] = GETAA(seq[0], z+1);
-            /* First y-ion */
-            f_Spectrum[ystart] = GETAA(seq[len-1], z+1) + H2O;
+            modNums[i] = bitmask & 0x0F;
+            modNums[i] -= 1;
+            bitmask = bitmask / 16;
 
-            /* Loop until length - 1 only */
-            for (uint_t l = 1; l < len - 1; l++)
+            if (modNums[i] != -1)
             {
-                /* Extract b-ions */
-                f_Spectrum[bstart + l] = f_Spectrum[bstart + (l-1)] + GETAA(seq[l], 0);
-
-                /* Extract y-ions */
-                f_Spectrum[ystart + l] = f_Spectrum[ystart + (l-1)] + GETAA(seq[len-1-l], 0);
+                modSeen++;
             }
         }
 
-        // integrize and copy to Spectrum
-        for (uint_t z = 0; z < maxz; z++)
+        for (int_t k = 0; k < modSeen; k++)
         {
-            /* Indices for b and y series start */
-            uint_t bstart = z * (len - 1);
-            uint_t ystart = z * (len - 1) + maxz * (len - 1);
+            bdelta[k] = static_cast<double>(gModInfo.vmods[modNums[k]].modMass) / scale;
+            ydelta[k] = static_cast<double>(gModInfo.vmods[modNums[modSeen - 1 - k]].modMass) / scale;
+        }
+    }
 
-            /* Loop until length - 1 only */
-            for (uint_t l = 0; l < len - 1; l++)
-            {
-                /* Extract b-ions */
-                Spectrum[bstart + l] = (uint_t)((f_Spectrum[bstart + l] * scale)/(z+1));
+    float_t *bions = ladder;
+    float_t *yions = ladder + maxz;
 
-                /* Extract y-ions */
-                Spectrum[ystart + l] = (uint_t)((f_Spectrum[ystart + l] * scale)/(z+1));
+    /* Mod sites seen so far from either terminus */
+    uint_t bmods = 0;
+    uint_t ymods = 0;
+
+    /* Mass of fragment = [M + (z-1)H]/z */
+
+    /* First b- and y-ions of all charges */
+    for (uint_t z = 0; z < maxz; z++)
+    {
+        bions[z] = GETAA(seq[0], z+1);
+        yions[z] = GETAA(seq[len-1], z+1) + H2O;
+    }
+
+    /* Loop until length - 1 only */
+    for (uint_t l = 0; l < nions; l++)
+    {
+        if (l > 0)
+        {
+            const double_t baa = GETAA(seq[l], 0);
+            const double_t yaa = GETAA(seq[len-1-l], 0);
+
+            /* Extend the ladders of all charges */
+            for (uint_t z = 0; z < maxz; z++)
+            {
+                bions[z] += baa;
+                yions[z] += yaa;
             }
         }
 
-        // clear the vector
-        f_Spectrum.clear();
+        if (modified)
+        {
+            bmods += ISBITSET(modInfo.sites, l) ? 1 : 0;
+            ymods += ISBITSET(modInfo.sites, len-1-l) ? 1 : 0;
+        }
+
+        for (uint_t z = 0; z < maxz; z++)
+        {
+            float_t bion = bions[z];
+            float_t yion = yions[z];
+
+            /* Add the masses of the mods seen so far */
+            for (uint_t k = 0; k < bmods; k++)
+                bion += bdelta[k];
+
+            for (uint_t k = 0; k < ymods; k++)
+                yion += ydelta[k];
 
+            /* Integrize and write to Spectrum */
+            Spectrum[z * nions + l] = (uint_t)((bion * scale) / (z + 1));
+            Spectrum[(maxz + z) * nions + l] = (uint_t)((yion * scale) / (z + 1));
+        }
     }
 
     return mass;
@@ -330,146 +408,3 @@ float_t UTILS_CalculateModMass(AA *seq, uint_t len, uint_t vModInfo)
     return mass;
 }
 
-/*
- * FUNCTION: UTILS_GenerateModSpectrum
- *
- * DESCRIPTION: Generates theoretical spectrum for a mod
- *
- * INPUT:
- * @seq     : Modified peptide sequence
- * @len     : Length of modified peptide
- * @Spectrum: Pointer to the theoretical spectrum
- * @modInfo : Modified peptide information
- *
- * OUTPUT:
- * @mass: Precursor mass of modified peptide
- */
-float_t UTILS_GenerateModSpectrum(char_t *seq, uint_t len, uint_t *Spectrum, modAA modInfo)
-{
-    /* Calculate Mod Peptide Mass */
-    status_t status = SLM_SUCCESS;
-    float_t mass = 0;
-
-    const double_t minmass = params.min_mass;
-    const double_t maxmass = params.max_mass;
-    const uint_t maxz = params.maxz;
-    const uint_t scale = params.scale;
-
-    char_t modPos[len] = {};
-    int_t modNums[MAX_MOD_TYPES] = {};
-    int_t modSeen = 0;
-
-    /* Check if valid modInfo */
-    if (modInfo.sites == 0 || modInfo.modNum == 0)
-    {
-        status = ERR_INVLD_MOD;
-        mass = NAA;
-    }
-
-    /* Compute Mod Mass */
-    if (status == SLM_SUCCESS)
-    {
-        mass = UTILS_CalculateModMass(seq, len, modInfo.modNum);
-    }
-
-    uint_t bitmask = modInfo.modNum;
-
-    /* Check if a valid precursor mass */
-    if (mass > minmass && mass < maxmass)
-    {
-        for (uint_t i = 0; i < MAX_MOD_TYPES; i++)
-        {
-            modNums[i] = bitmask & 0x0F;
-            modNums[i] -= 1;
-            bitmask = bitmask / 16;
-
-            if (modNums[i] != -1)
-            {
-                modSeen++;
-            }
-        }
-
-        for (uint_t i = 0; i < len; i++)
-        {
-            modPos[i] = ISBITSET(modInfo.sites,i) ? 1 : 0;
-        }
-
-        if (mass > 0)
-        {
-            // vector for floating point spectrum
-            std::vector<float> f_Spectrum(iSERIES * maxz * (len-1));
-
-            /* Generate Normal Spectrum */
-            for (uint_t z = 0; z < maxz; z++)
-            {
-                /* Indices for b and y series start */
-                uint_t bstart = z * (len - 1);
-                uint_t ystart = z * (len -1)  + maxz * (len - 1);
-
-                /* Mass of fragment = [M + (z-1)H]/z */
-
-                /* First b-ion */
-                f_Spectrum[bstart] = GETAA(seq[0], z+1);
-                /* First y-ion */
-                f_Spectrum[ystart] = GETAA(seq[len-1], z+1) + H2O;
-
-                /* Loop until length - 1 only */
-                for (uint_t l = 1; l < len - 1; l++)
-                {
-                    /* Extract b-ions */
-                    f_Spectrum[bstart + l] = f_Spectrum[bstart + (l - 1)] + GETAA(seq[l], 0);
-
-                    /* Extract y-ions */
-                    f_Spectrum[ystart + l] = f_Spectrum[ystart + (l - 1)] + GETAA(seq[len-1-l], 0);
-                }
-            }
-
-            /* Adjust b-ions with additional masses */
-            for (uint_t z = 0; z < maxz; z++)
-            {
-                /* Indices for b series start */
-                uint_t bstart = z * (len-1);
-                uint_t counter = 0;
-
-                /* Loop until length - 1 only */
-                for (uint_t l = 0; l < len - 1; l++)
-                {
-                    counter += modPos[l];
-
-                    for (uint_t k = 0; k < counter; k++)
-                        f_Spectrum[bstart + l] += static_cast<double>(gModInfo.vmods[modNums[k]].modMass) / scale;
-
-
-                    // integrize and write to Spectrum
-                    Spectrum[bstart + l] = (uint_t)(f_Spectrum[bstart + l] * scale /(z + 1));
-                }
-            }
-
-            /*  Adjust y-ions with additional masses */
-            for (uint_t z = 0; z < maxz; z++)
-            {
-                /* Indices for y series start */
-                uint_t ystart = z * (len -1) + maxz * (len -1);
-                uint_t counter = 0;
-
-                /* Loop until length - 1 only */
-                for (int_t l = (len - 1); l > 0; l--)
-                {
-                    counter += modPos[l];
-
-                    for (uint_t k = 0; k < counter; k++)
-                        f_Spectrum[ystart + (len - 1) - l] += static_cast<double>(gModInfo.vmods[modNums[modSeen - 1 - k]].modMass)/scale;
-
-                    // integrize and write to Spectrum
-                    Spectrum[ystart + (len - 1) - l] = (uint_t)(f_Spectrum[ystart + (len - 1) - l] * scale / (z + 1));
-                }
-            }
-
-            // clear the vector
-            f_Spectrum.clear();
-        }
-    }
-
-    return mass;
-}
-